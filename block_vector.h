@@ -0,0 +1,272 @@
+#ifndef BWGAME_BLOCK_VECTOR_H
+#define BWGAME_BLOCK_VECTOR_H
+
+#include <cstddef>
+#include <iterator>
+#include <array>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+
+namespace bwgame {
+
+// A sequence stored as a vector of fixed size blocks, each of which is
+// partially filled. Inserting or erasing only moves the elements of one block
+// (and occasionally splits or merges two), and a sorted block_vector can be
+// searched with lower_bound/upper_bound by first finding the block by its first
+// element. The element order is exactly that of a std::vector given the same
+// sequence of insert and erase calls.
+// Like std::vector, any insert or erase invalidates all iterators.
+template<typename T, size_t block_size, typename allocator_T = std::allocator<T>>
+struct block_vector {
+	static_assert(block_size >= 4, "block_size too small");
+	using value_type = T;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+	using reference = value_type&;
+	using const_reference = const value_type&;
+	using pointer = value_type*;
+	using const_pointer = const value_type*;
+
+private:
+	struct block {
+		size_t size = 0;
+		std::array<T, block_size> data;
+	};
+	using block_allocator = typename std::allocator_traits<allocator_T>::template rebind_alloc<block>;
+	// The last block is always empty, and is where end() points.
+	std::vector<block, block_allocator> blocks = std::vector<block, block_allocator>(1);
+	size_t n = 0;
+
+	template<bool is_const>
+	struct t_iterator {
+	private:
+		friend block_vector;
+		friend t_iterator<!is_const>;
+		using block_pointer = typename std::conditional<is_const, const block*, block*>::type;
+		using element_pointer = typename std::conditional<is_const, const T*, T*>::type;
+		block_pointer b = nullptr;
+		element_pointer p = nullptr;
+		element_pointer block_end = nullptr;
+		t_iterator(block_pointer b, element_pointer p) : b(b), p(p), block_end(b->data.data() + b->size) {}
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = typename block_vector::value_type;
+		using difference_type = typename block_vector::difference_type;
+		using pointer = element_pointer;
+		using reference = typename std::conditional<is_const, const value_type&, value_type&>::type;
+
+		t_iterator() = default;
+		template<bool rhs_const, typename std::enable_if<is_const && !rhs_const>::type* = nullptr>
+		t_iterator(const t_iterator<rhs_const>& n) : b(n.b), p(n.p), block_end(n.block_end) {}
+
+		reference operator*() const {
+			return *p;
+		}
+		pointer operator->() const {
+			return p;
+		}
+		t_iterator& operator++() {
+			if (++p == block_end) {
+				++b;
+				p = b->data.data();
+				block_end = p + b->size;
+			}
+			return *this;
+		}
+		t_iterator operator++(int) {
+			auto r = *this;
+			++*this;
+			return r;
+		}
+		t_iterator& operator--() {
+			if (p == b->data.data()) {
+				--b;
+				p = b->data.data() + b->size;
+				block_end = p;
+			}
+			--p;
+			return *this;
+		}
+		t_iterator operator--(int) {
+			auto r = *this;
+			--*this;
+			return r;
+		}
+		bool operator==(const t_iterator& n) const {
+			return p == n.p;
+		}
+		bool operator!=(const t_iterator& n) const {
+			return p != n.p;
+		}
+	};
+
+	template<typename iterator_T, typename blocks_T>
+	static iterator_T make_iterator(blocks_T& blocks, size_t block_index, size_t index) {
+		auto* b = blocks.data() + block_index;
+		if (index == b->size && block_index != blocks.size() - 1) {
+			++b;
+			index = 0;
+		}
+		return iterator_T(b, b->data.data() + index);
+	}
+
+	void merge_next(size_t block_index) {
+		auto& a = blocks[block_index];
+		auto& b = blocks[block_index + 1];
+		std::move(b.data.begin(), b.data.begin() + b.size, a.data.begin() + a.size);
+		a.size += b.size;
+		blocks.erase(blocks.begin() + block_index + 1);
+	}
+
+	// The first element for which pred is false, in a range where pred is true
+	// for some prefix. Unlike std::partition_point this does not branch on pred,
+	// which is faster for the unpredictable searches the unit finder does.
+	template<typename ptr_T, typename pred_T>
+	static ptr_T partition_point(ptr_T first, size_t size, pred_T&& pred) {
+		if (size == 0) return first;
+		while (size > 1) {
+			size_t half = size / 2;
+			first = pred(first[half]) ? first + half : first;
+			size -= half;
+		}
+		return first + pred(*first);
+	}
+
+	template<typename iterator_T, typename blocks_T, typename pred_T>
+	static iterator_T partition_point(blocks_T& blocks, pred_T&& pred) {
+		auto* b = partition_point(blocks.data(), blocks.size() - 1, [&](const block& b) {
+			return pred(b.data[0]);
+		});
+		if (b == blocks.data()) return iterator_T(b, b->data.data());
+		--b;
+		auto* p = partition_point(b->data.data() + 1, b->size - 1, pred);
+		return make_iterator<iterator_T>(blocks, b - blocks.data(), p - b->data.data());
+	}
+
+public:
+	using iterator = t_iterator<false>;
+	using const_iterator = t_iterator<true>;
+
+	block_vector() = default;
+	block_vector(const block_vector&) = default;
+	block_vector(block_vector&& other) : blocks(std::move(other.blocks)), n(other.n) {
+		other.clear();
+	}
+	block_vector& operator=(const block_vector&) = default;
+	block_vector& operator=(block_vector&& other) {
+		blocks = std::move(other.blocks);
+		n = other.n;
+		other.clear();
+		return *this;
+	}
+
+	iterator begin() {
+		return iterator(blocks.data(), blocks.front().data.data());
+	}
+	iterator end() {
+		return iterator(&blocks.back(), blocks.back().data.data());
+	}
+	const_iterator begin() const {
+		return const_iterator(blocks.data(), blocks.front().data.data());
+	}
+	const_iterator end() const {
+		return const_iterator(&blocks.back(), blocks.back().data.data());
+	}
+	const_iterator cbegin() const {
+		return begin();
+	}
+	const_iterator cend() const {
+		return end();
+	}
+
+	size_t size() const {
+		return n;
+	}
+	bool empty() const {
+		return n == 0;
+	}
+	void clear() {
+		blocks.resize(1);
+		n = 0;
+	}
+
+	iterator insert(const_iterator pos, const T& value) {
+		size_t block_index = pos.b - blocks.data();
+		size_t index = pos.p - pos.b->data.data();
+		if (block_index == blocks.size() - 1 && block_index != 0) {
+			--block_index;
+			index = blocks[block_index].size;
+		}
+		if (blocks.size() == 1) blocks.emplace_back();
+		if (blocks[block_index].size == block_size) {
+			blocks.emplace(blocks.begin() + block_index + 1);
+			auto& a = blocks[block_index];
+			auto& b = blocks[block_index + 1];
+			size_t half = block_size / 2;
+			std::move(a.data.begin() + half, a.data.end(), b.data.begin());
+			b.size = block_size - half;
+			a.size = half;
+			if (index > half) {
+				++block_index;
+				index -= half;
+			}
+		}
+		auto& b = blocks[block_index];
+		std::move_backward(b.data.begin() + index, b.data.begin() + b.size, b.data.begin() + b.size + 1);
+		b.data[index] = value;
+		++b.size;
+		++n;
+		return iterator(&b, b.data.data() + index);
+	}
+
+	iterator erase(const_iterator pos) {
+		size_t block_index = pos.b - blocks.data();
+		size_t index = pos.p - pos.b->data.data();
+		auto& b = blocks[block_index];
+		std::move(b.data.begin() + index + 1, b.data.begin() + b.size, b.data.begin() + index);
+		--b.size;
+		--n;
+		if (b.size == 0) {
+			blocks.erase(blocks.begin() + block_index);
+			return make_iterator<iterator>(blocks, block_index, 0);
+		}
+		if (b.size < block_size / 4) {
+			if (block_index + 2 != blocks.size() && b.size + blocks[block_index + 1].size <= block_size / 2) {
+				merge_next(block_index);
+			} else if (block_index != 0 && blocks[block_index - 1].size + b.size <= block_size / 2) {
+				index += blocks[block_index - 1].size;
+				--block_index;
+				merge_next(block_index);
+			}
+		}
+		return make_iterator<iterator>(blocks, block_index, index);
+	}
+
+	void push_back(const T& value) {
+		insert(end(), value);
+	}
+
+	// For a sequence sorted by cmp, where cmp(element, value) is true for
+	// elements that are ordered before value.
+	template<typename V, typename cmp_T>
+	iterator lower_bound(const V& value, cmp_T&& cmp) {
+		return partition_point<iterator>(blocks, [&](const T& e) {
+			return cmp(e, value);
+		});
+	}
+
+	// For a sequence sorted by cmp, where cmp(value, element) is true for
+	// elements that are ordered after value.
+	template<typename V, typename cmp_T>
+	iterator upper_bound(const V& value, cmp_T&& cmp) {
+		return partition_point<iterator>(blocks, [&](const T& e) {
+			return !cmp(value, e);
+		});
+	}
+};
+
+}
+
+#endif
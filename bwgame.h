@@ -7,6 +7,7 @@
 #include "data_loading.h"
 #include "bwenums.h"
 #include "korean.h"
+#include "instrumentation.h"
 
 #include <algorithm>
 #include <utility>
@@ -99,6 +100,14 @@ struct autocast {
 
 using unit_type_autocast = autocast<const unit_type_t*>;
 
+// global_state holds data that only depends on the game data files. It is
+// filled in once by global_init and never modified afterwards; state only
+// refers to it through a const pointer and nothing in state_functions writes
+// to it. A single global_state can therefore be shared by any number of
+// states, including states that are simulated concurrently on different
+// threads, as long as global_init has completed before any of them start and
+// the global_state outlives them. See make_shared_global_state and
+// game_player::init.
 struct global_state {
 
 	global_state() = default;
@@ -129,6 +138,17 @@ struct global_state {
 	std::array<a_vector<uint8_t>, 8> tileset_cv5;
 };
 
+// Storage for the regions that game_load_functions::regions_create generates
+// for a map, so that loading the same map again (possibly in another process)
+// can skip generating them. Keys are hashes of everything regions_create
+// reads, and data is whatever was passed to put for the same key.
+struct regions_cache_t {
+	virtual ~regions_cache_t() {}
+	// Returns false if nothing is stored for key.
+	virtual bool get(uint64_t key, a_vector<uint8_t>& data) = 0;
+	virtual void put(uint64_t key, const a_vector<uint8_t>& data) = 0;
+};
+
 struct game_state {
 
 	game_state() = default;
@@ -187,6 +207,97 @@ struct game_state {
 	regions_t regions;
 
 	a_vector<trigger> triggers;
+
+	// Set once game_load_functions::load_map_data has filled in everything
+	// above. A loaded game_state is never modified again; load_map_data reuses
+	// it instead of loading it again when another game is started on the same
+	// map with the same settings, so any number of states (on any threads)
+	// can share a single loaded game_state.
+	// Everything that can differ between two games on the same map (unit,
+	// weapon, upgrade and tech types and triggers) only depends on whether
+	// map settings are used and whether melee triggers are loaded, so those
+	// are recorded here and must match for the game_state to be reused.
+	bool loaded = false;
+	uint64_t map_data_hash = 0;
+	bool use_map_settings = false;
+	bool melee_triggers = false;
+
+	// If set, load_map_data looks up the regions here before generating them,
+	// and stores them after generating them.
+	regions_cache_t* regions_cache = nullptr;
+};
+
+// Copies of the unit finder bounding box of every unit ({-1, -1} while a
+// unit is not in the unit finder), one array per coordinate, indexed by unit
+// index, so that a search can test every unit with a few passes over
+// contiguous memory instead of following unit pointers. Only maintained while
+// enabled (see state_functions::enable_unit_soa).
+struct unit_soa_t {
+	bool enabled = false;
+	a_vector<int> from_x;
+	a_vector<int> from_y;
+	a_vector<int> to_x;
+	a_vector<int> to_y;
+};
+
+// Copies of visible and explored of st.tiles as one bitboard per player, with
+// bits set for tiles that are visible to or explored by the player: tile
+// (x, y) is bit x % 64 of word y * row_words + x / 64. Only maintained while
+// enabled (see state_functions::enable_vision_bitboards).
+// The tiles remain authoritative, and reveal_sight_at still walks the sight
+// mask tile by tile rather than ORing a mask into the boards, since which
+// tiles ground units see depends on the height flags of the tiles around
+// each position, not only on the sight range.
+struct vision_bitboards_t {
+	bool enabled = false;
+	size_t row_words = 0;
+	std::array<a_vector<uint64_t>, 8> visible;
+	std::array<a_vector<uint64_t>, 8> explored;
+};
+
+// Reference counts of the sight that units reveal when update_tiles is set,
+// so that the sight of units that have not moved to another tile or changed
+// sight range, owner or in_air since the last update does not have to be
+// propagated again. Every unit that revealed sight in update_units the last
+// time update_tiles was set is a source, counts holds for every tile and
+// player the number of sources that reveal the tile to the player, and
+// visible_to the players with a nonzero count. Only maintained while enabled
+// (see state_functions::enable_incremental_vision).
+struct incremental_vision_t {
+	struct source {
+		// -1 for units that are not a source.
+		int tile_index = -1;
+		int range = 0;
+		int reveal_to = 0;
+		// The ground height at the position, or -1 for air units.
+		int height = 0;
+		// The value of generation when the unit last revealed its sight.
+		uint32_t generation = 0;
+	};
+	bool enabled = false;
+	uint32_t generation = 0;
+	// Indexed by unit index.
+	a_vector<source> sources;
+	// Indexed by tile index.
+	a_vector<std::array<uint16_t, 8>> counts;
+	a_vector<uint8_t> visible_to;
+};
+
+// A set of unit types, for state_functions::find_units_in_rect.
+struct unit_type_mask {
+	std::array<uint64_t, ((size_t)UnitTypes::None + 63) / 64> bits{};
+
+	static unit_type_mask all() {
+		unit_type_mask r;
+		for (auto& v : r.bits) v = ~(uint64_t)0;
+		return r;
+	}
+	void set(UnitTypes id) {
+		bits[(size_t)id / 64] |= (uint64_t)1 << ((size_t)id % 64);
+	}
+	bool test(UnitTypes id) const {
+		return (bits[(size_t)id / 64] >> ((size_t)id % 64)) & 1;
+	}
 };
 
 struct state_base_copyable {
@@ -268,6 +379,10 @@ struct state_base_copyable {
 	bool cheat_operation_cwal;
 
 	a_vector<location> locations;
+
+	unit_soa_t unit_soa;
+	vision_bitboards_t vision_bitboards;
+	incremental_vision_t incremental_vision;
 };
 
 struct psionic_matrix_link_f {
@@ -310,28 +425,73 @@ struct state_base_non_copyable {
 
 	intrusive_list<path_t, default_link_f> free_paths;
 	a_list<path_t> paths;
+	// Paths removed from the end of paths by state_snapshot::restore, in order.
+	// New paths are taken from here first so that they keep their addresses.
+	a_list<path_t> unused_paths;
 
 	intrusive_list<thingy_t, default_link_f> active_thingies;
 	intrusive_list<thingy_t, default_link_f> free_thingies;
 	a_list<thingy_t> thingies;
+	a_list<thingy_t> unused_thingies;
 
 	struct unit_finder_entry {
 		unit_t* u;
 		int value;
 	};
-	a_vector<unit_finder_entry> unit_finder_x;
-	a_vector<unit_finder_entry> unit_finder_y;
+	using unit_finder_list = a_block_vector<unit_finder_entry, 64>;
+	unit_finder_list unit_finder_x;
+	unit_finder_list unit_finder_y;
 
-	const unit_t* consider_collision_with_unit_bug;
-	const unit_t* prev_bullet_source_unit;
+	const unit_t* consider_collision_with_unit_bug = nullptr;
+	const unit_t* prev_bullet_source_unit = nullptr;
 };
 
 struct state : state_base_copyable, state_base_non_copyable {
 };
 
+struct state_functions;
+
+// reveal_sight_at calls collected by state_functions::update_units when
+// state_functions::sight_batch is set, to be applied at once by apply (see
+// parallel_vision.h).
+struct sight_batch_t {
+	struct entry {
+		xy pos;
+		int range;
+		int reveal_to;
+		bool in_air;
+	};
+	a_vector<entry> entries;
+	virtual ~sight_batch_t() {}
+	virtual void apply(state_functions& funcs) = 0;
+};
+
+// The tiles state_functions::spread_creep picks from, kept up to date by
+// state_functions::set_tile_creep while creep is spread repeatedly from the
+// same position (see state_functions::spread_creep_completely), so that the
+// area does not have to be scanned again for every tile.
+struct creep_frontier_t {
+	rect_t<xy_t<size_t>> area;
+	// Indexed by tile position relative to area.from. Candidates are the
+	// tiles that spread_creep would consider, apart from their number of
+	// neighboring creep tiles.
+	a_vector<uint8_t> candidate;
+	a_vector<uint8_t> n_neighboring_creep_tiles;
+	// The tile indices of the candidates with 1 to 8 neighboring creep tiles,
+	// in the order spread_creep finds them.
+	std::array<static_vector<size_t, 240>, 8> target_tiles;
+};
+
 struct state_functions {
 
+#ifdef OPENBW_HEADLESS
+	// Headless builds (see update_thingy_sprite_visibility) never play sounds,
+	// so the call is not virtual and compiles away. Arguments such as lcg_rand
+	// calls are still evaluated by the callers.
+	void play_sound(int id, xy position, const unit_t* source_unit = nullptr, bool add_race_index = false) {}
+#else
 	virtual void play_sound(int id, xy position, const unit_t* source_unit = nullptr, bool add_race_index = false) {}
+#endif
 	virtual void on_unit_deselect(unit_t* u) {}
 
 	virtual void on_unit_destroy(unit_t* u) {}
@@ -354,7 +514,20 @@ struct state_functions {
 	flingy_t* iscript_flingy = nullptr;
 	bullet_t* iscript_bullet = nullptr;
 	unit_t* iscript_unit = nullptr;
-	mutable size_t unit_finder_search_index = 0;
+	mutable size_t unit_finder_active_searches = 0;
+	// Apply the unit finder moves of the movement loop in batches (see
+	// unit_finder_flush).
+	bool batch_unit_finder_reinsert = false;
+	bool defer_unit_finder_reinsert = false;
+	sight_batch_t* sight_batch = nullptr;
+	bool defer_sight = false;
+	// Set by update_units while refresh_unit_vision should count the sight of
+	// units in st.incremental_vision instead of revealing it.
+	bool count_sight = false;
+	creep_frontier_t* creep_frontier = nullptr;
+#ifdef OPENBW_ENABLE_INSTRUMENTATION
+	::bwgame::instrumentation::recorder* instrumentation = nullptr;
+#endif
 
 	const order_type_t* get_order_type(Orders id) const {
 		if ((size_t)id >= 189) error("invalid order id %d", (size_t)id);
@@ -2364,7 +2537,7 @@ struct state_functions {
 				thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Zerg_Building_Spawn_Small), u->sprite->position, 0);
 				if (t) {
 					t->sprite->elevation_level = u->sprite->elevation_level + 1;
-					if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+					update_thingy_sprite_visibility(t);
 				}
 				const unit_type_t* build_type = u->unit_type;
 				morph_unit(u, get_unit_type(UnitTypes::Zerg_Drone));
@@ -3439,7 +3612,7 @@ struct state_functions {
 				auto* t = create_thingy(get_sprite_type(sprite_id), sprite->position + offset, 0);
 				if (t) {
 					t->sprite->elevation_level = sprite->elevation_level + 1;
-					if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+					update_thingy_sprite_visibility(t);
 					if (flipped) {
 						for (auto* image : ptr(t->sprite->images)) {
 							set_image_frame_index_offset(image, image->frame_index_offset, true);
@@ -4541,7 +4714,7 @@ struct state_functions {
 				thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Hallucination_Death1), u->sprite->position, 0);
 				if (t) {
 					t->sprite->elevation_level = u->sprite->elevation_level + 1;
-					if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+					update_thingy_sprite_visibility(t);
 				}
 			}
 			hide_unit(u);
@@ -6233,7 +6406,7 @@ struct state_functions {
 			u->ghost.nuke_dot = t;
 			if (t) {
 				t->sprite->elevation_level = u->sprite->elevation_level + 1;
-				if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+				update_thingy_sprite_visibility(t);
 			}
 			u->order_state = 6;
 		} else if (u->order_state == 6) {
@@ -7157,7 +7330,7 @@ struct state_functions {
 			thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Recall_Field), u->order_target.pos, 0);
 			if (t) {
 				t->sprite->elevation_level = u->sprite->elevation_level + 1;
-				if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+				update_thingy_sprite_visibility(t);
 			}
 			play_sound(550 + lcg_rand(17) % 2, u->order_target.pos);
 			u->main_order_timer = 22;
@@ -7206,7 +7379,7 @@ struct state_functions {
 				thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Recall_Field), r.second, 0);
 				if (t) {
 					t->sprite->elevation_level = target->sprite->elevation_level + 1;
-					if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+					update_thingy_sprite_visibility(t);
 				}
 				if (unit_is_ghost(target) && target->connected_unit && unit_is(target->connected_unit, UnitTypes::Terran_Nuclear_Missile)) {
 					target->connected_unit->connected_unit = nullptr;
@@ -7570,7 +7743,7 @@ struct state_functions {
 					thingy_t* t = create_thingy(get_sprite_type(sprite_id), u->sprite->position, 0);
 					if (t) {
 						t->sprite->elevation_level = u->sprite->elevation_level + 1;
-						if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+						update_thingy_sprite_visibility(t);
 					}
 				} else {
 					create_sized_image(u, ImageTypes::IMAGEID_Feedback_Small);
@@ -7621,6 +7794,7 @@ struct state_functions {
 	}
 
 	void execute_main_order(unit_t* u) {
+		OPENBW_INSTRUMENT_SCOPE(execute_main_order);
 		switch (u->order_type->id) {
 		case Orders::Die:
 			order_Die(u);
@@ -8446,6 +8620,7 @@ struct state_functions {
 	}
 
 	void update_unit(unit_t* u) {
+		OPENBW_INSTRUMENT_SCOPE(update_unit);
 
 		update_unit_values(u);
 
@@ -8989,6 +9164,8 @@ struct state_functions {
 	unit_t* check_unit_movement_unit_collision(unit_t* u, const execute_movement_struct& ems) {
 		if (us_hidden(u)) return nullptr;
 		xy movement = ems.position - u->sprite->position;
+		if (movement == xy()) return nullptr;
+		unit_finder_flush();
 
 		auto cmp_u = [&](int a, auto& b) {
 			return a < b.value;
@@ -9003,7 +9180,7 @@ struct state_functions {
 
 		if (movement.x < 0) {
 			auto& arr = st.unit_finder_x;
-			for (auto i = std::upper_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.from.x, cmp_u); i != arr.begin();) {
+			for (auto i = arr.upper_bound(u->unit_finder_bounding_box.from.x, cmp_u); i != arr.begin();) {
 				--i;
 				if (i->value < new_bb.from.x) break;
 				if (i->u->unit_finder_bounding_box.from.y <= new_bb.to.y && i->u->unit_finder_bounding_box.to.y >= new_bb.from.y) {
@@ -9014,7 +9191,7 @@ struct state_functions {
 			}
 		} else if (movement.x > 0) {
 			auto& arr = st.unit_finder_x;
-			for (auto i = std::lower_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.to.x, cmp_l); i != arr.end(); ++i) {
+			for (auto i = arr.lower_bound(u->unit_finder_bounding_box.to.x, cmp_l); i != arr.end(); ++i) {
 				if (i->value > new_bb.to.x) break;
 				if (i->u->unit_finder_bounding_box.from.y <= new_bb.to.y && i->u->unit_finder_bounding_box.to.y >= new_bb.from.y) {
 					if (unit_can_collide_with(u, i->u) && u_ground_unit(i->u)) {
@@ -9025,7 +9202,7 @@ struct state_functions {
 		}
 		if (movement.y < 0) {
 			auto& arr = st.unit_finder_y;
-			for (auto i = std::upper_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.from.y, cmp_u); i != arr.begin();) {
+			for (auto i = arr.upper_bound(u->unit_finder_bounding_box.from.y, cmp_u); i != arr.begin();) {
 				--i;
 				if (i->value < new_bb.from.y) break;
 				if (i->u->unit_finder_bounding_box.from.x <= new_bb.to.x && i->u->unit_finder_bounding_box.to.x >= new_bb.from.x) {
@@ -9036,7 +9213,7 @@ struct state_functions {
 			}
 		} else if (movement.y > 0) {
 			auto& arr = st.unit_finder_y;
-			for (auto i = std::lower_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.to.y, cmp_l); i != arr.end(); ++i) {
+			for (auto i = arr.lower_bound(u->unit_finder_bounding_box.to.y, cmp_l); i != arr.end(); ++i) {
 				if (i->value > new_bb.to.y) break;
 				if (i->u->unit_finder_bounding_box.from.x <= new_bb.to.x && i->u->unit_finder_bounding_box.to.x >= new_bb.from.x) {
 					if (unit_can_collide_with(u, i->u) && u_ground_unit(i->u)) {
@@ -9188,6 +9365,49 @@ struct state_functions {
 		bool consider_collision_with_moving_units = false;
 	};
 
+	// Per search values for each region, indexed by region index. A value is
+	// only valid if its epoch matches the current one, so reset clears the
+	// whole table by incrementing the epoch. This keeps the pathfinders from
+	// writing to the regions, which can then be shared between states.
+	template<typename T>
+	struct region_side_table {
+		a_vector<uint32_t> epochs;
+		a_vector<T> values;
+		uint32_t epoch = 0;
+		void reset(size_t size) {
+			if (epochs.size() != size) {
+				epochs.assign(size, 0);
+				values.assign(size, T());
+				epoch = 0;
+			}
+			if (++epoch == 0) {
+				std::fill(epochs.begin(), epochs.end(), 0);
+				epoch = 1;
+			}
+		}
+		T get(const regions_t::region* r) const {
+			return epochs[r->index] == epoch ? values[r->index] : T();
+		}
+		void set(const regions_t::region* r, T value) {
+			epochs[r->index] = epoch;
+			values[r->index] = value;
+		}
+	};
+	mutable region_side_table<void*> long_path_region_nodes;
+	mutable region_side_table<int> short_path_region_flags;
+
+	// Containers used by pathfinder_find_short_path, which are kept between
+	// searches so that their memory is reused.
+	struct short_path_scratch_t {
+		std::array<a_vector<regions_t::contour>, 4> local_edges;
+		a_vector<rect> visited_areas;
+	};
+	mutable short_path_scratch_t short_path_scratch;
+
+	// Results are not cached: costs and the heuristic are measured from the
+	// exact source and destination positions, so a path found for the same
+	// pair of regions from other positions can differ, and returning it
+	// would break replay sync.
 	bool pathfinder_find_long_path(pathfinder& pf) const {
 		if (pf.source_region == pf.destination_region) return false;
 
@@ -9205,9 +9425,9 @@ struct state_functions {
 				return a->estimated_final_cost < b->estimated_final_cost;
 			}
 		};
-		a_vector<node_t*> open;
+		static_vector<node_t*, 125> open;
 
-		a_list<node_t> all_nodes;
+		static_vector<node_t, 350> all_nodes;
 
 		node_t* goal_node = nullptr;
 
@@ -9224,6 +9444,7 @@ struct state_functions {
 			all_nodes.clear();
 			open.clear();
 			goal_node = nullptr;
+			long_path_region_nodes.reset(game_st.regions.regions.size());
 
 			all_nodes.emplace_back();
 			node_t* start_node = &all_nodes.back();
@@ -9231,7 +9452,7 @@ struct state_functions {
 			start_node->region = from_region;
 			start_node->estimated_remaining_cost = fp8::integer(128 * 128);
 			start_node->estimated_final_cost = start_node->estimated_remaining_cost;
-			start_node->region->pathfinder_node = (void*)start_node;
+			long_path_region_nodes.set(start_node->region, start_node);
 
 			open.push_back(start_node);
 			binary_heap_up(std::prev(open.end()), open.begin(), open.end(), cmp_node());
@@ -9257,7 +9478,7 @@ struct state_functions {
 						cost *= 2;
 					}
 					fp8 total_cost = cur->total_cost + cost;
-					node_t* n = (node_t*)r->pathfinder_node;
+					node_t* n = (node_t*)long_path_region_nodes.get(r);
 					if (!n) {
 						all_nodes.emplace_back();
 						n = &all_nodes.back();
@@ -9268,7 +9489,7 @@ struct state_functions {
 						n->estimated_remaining_cost = xy_length(to_pos - pos);
 						n->estimated_final_cost = n->total_cost + n->estimated_remaining_cost;
 						n->visited = false;
-						r->pathfinder_node = (void*)n;
+						long_path_region_nodes.set(r, n);
 						open.push_back(n);
 						binary_heap_up(std::prev(open.end()), open.begin(), open.end(), cmp_node());
 					} else if (cur->prev != n) {
@@ -9331,9 +9552,6 @@ struct state_functions {
 			find(pf.destination_region, pf.source_region);
 			path_is_reversed = true;
 			if (goal_node->region != pf.source_region) {
-				for (auto& v : all_nodes) {
-					v.region->pathfinder_node = nullptr;
-				}
 				find(pf.source_region, goal_node->region);
 				path_is_reversed = false;
 			}
@@ -9364,9 +9582,6 @@ struct state_functions {
 			}
 		}
 		pf.full_long_path_size = full_path_size;
-		for (auto& v : all_nodes) {
-			v.region->pathfinder_node = nullptr;
-		}
 		return !pf.long_path.empty();
 	}
 
@@ -9427,9 +9642,10 @@ struct state_functions {
 
 		const regions_t::region* move_to_region = target_region ? target_region : destination_region;
 
+		short_path_region_flags.reset(game_st.regions.regions.size());
 		for (auto* nr : move_to_region->walkable_neighbors) {
 			if (nr == source_region) continue;
-			nr->pathfinder_flag = 1;
+			short_path_region_flags.set(nr, 1);
 		}
 
 		struct pf_search {
@@ -9445,7 +9661,7 @@ struct state_functions {
 			xy cur_pos_max;
 			xy cur_pos_min;
 
-			std::array<a_vector<regions_t::contour>, 4> local_edges;
+			std::array<a_vector<regions_t::contour>, 4>& local_edges;
 
 			std::array<const regions_t::contour*, 4> nearest_edge;
 
@@ -9456,10 +9672,15 @@ struct state_functions {
 			};
 			static_vector<neighbor_t, 32> neighbors;
 
-			a_vector<rect> visited_areas;
+			a_vector<rect>& visited_areas;
+
+			explicit pf_search(short_path_scratch_t& scratch) : local_edges(scratch.local_edges), visited_areas(scratch.visited_areas) {
+				for (auto& v : local_edges) v.clear();
+				visited_areas.clear();
+			}
 		};
 
-		pf_search w;
+		pf_search w(short_path_scratch);
 
 		w.u = pf.u;
 		w.target_unit = pf.target_unit;
@@ -9509,10 +9730,10 @@ struct state_functions {
 
 		struct visited {
 			int x;
-			a_vector<std::pair<int, int>> y;
+			static_vector<std::pair<int, int>, 10> y;
 		};
 
-		a_vector<visited> pf_area_visited;
+		static_vector<visited, 128 + 1> pf_area_visited;
 		pf_area_visited.push_back({0, {}});
 		pf_area_visited.push_back({(int)game_st.map_width, {}});
 
@@ -9646,10 +9867,11 @@ struct state_functions {
 		};
 
 		auto pf_add_local_units = [&]() {
+			unit_finder_flush();
 			auto cmp_l = [&](auto& a, int b) {
 				return a.value < b;
 			};
-			for (auto i = std::lower_bound(st.unit_finder_y.begin(), st.unit_finder_y.end(), w.cur_pos_min.y - w.inner[0] - 1, cmp_l); i != st.unit_finder_y.end(); ++i) {
+			for (auto i = st.unit_finder_y.lower_bound(w.cur_pos_min.y - w.inner[0] - 1, cmp_l); i != st.unit_finder_y.end(); ++i) {
 				auto& bb = i->u->unit_finder_bounding_box;
 				if (i->value >= w.cur_pos.y - w.inner[0]) break;
 				if (i->value == bb.to.y) {
@@ -9666,7 +9888,7 @@ struct state_functions {
 					}
 				}
 			}
-			for (auto i = std::lower_bound(st.unit_finder_x.begin(), st.unit_finder_x.end(), w.cur_pos.x - w.inner[1], cmp_l); i != st.unit_finder_x.end(); ++i) {
+			for (auto i = st.unit_finder_x.lower_bound(w.cur_pos.x - w.inner[1], cmp_l); i != st.unit_finder_x.end(); ++i) {
 				auto& bb = i->u->unit_finder_bounding_box;
 				if (i->value > w.cur_pos_max.x - w.inner[1] + 1) break;
 				if (i->value == bb.from.x) {
@@ -9683,7 +9905,7 @@ struct state_functions {
 					}
 				}
 			}
-			for (auto i = std::lower_bound(st.unit_finder_y.begin(), st.unit_finder_y.end(), w.cur_pos.y - w.inner[2], cmp_l); i != st.unit_finder_y.end(); ++i) {
+			for (auto i = st.unit_finder_y.lower_bound(w.cur_pos.y - w.inner[2], cmp_l); i != st.unit_finder_y.end(); ++i) {
 				auto& bb = i->u->unit_finder_bounding_box;
 				if (i->value > w.cur_pos_max.y - w.inner[2] + 1) break;
 				if (i->value == bb.from.y) {
@@ -9700,7 +9922,7 @@ struct state_functions {
 					}
 				}
 			}
-			for (auto i = std::lower_bound(st.unit_finder_x.begin(), st.unit_finder_x.end(), w.cur_pos_min.x - w.inner[3] - 1, cmp_l); i != st.unit_finder_x.end(); ++i) {
+			for (auto i = st.unit_finder_x.lower_bound(w.cur_pos_min.x - w.inner[3] - 1, cmp_l); i != st.unit_finder_x.end(); ++i) {
 				auto& bb = i->u->unit_finder_bounding_box;
 				if (i->value >= w.cur_pos.x - w.inner[3]) break;
 				if (i->value == bb.to.x) {
@@ -10425,7 +10647,7 @@ struct state_functions {
 					n->estimated_final_cost = n->total_cost + n->estimated_remaining_cost;
 					n->visited = n->directional_flags == 0 && !n->is_goal;
 					n->is_target_region = n->region == target_region;
-					n->is_neighbor_region = n->region->pathfinder_flag != 0;
+					n->is_neighbor_region = short_path_region_flags.get(n->region) != 0;
 					n->is_goal = v.is_goal;
 					if (!n->visited) {
 						open.push_back(n);
@@ -10474,7 +10696,8 @@ struct state_functions {
 			int n_unvisited_destination_region_nodes = 0;
 
 			for (auto i = std::next(all_nodes.begin()); i != all_nodes.end(); ++i) {
-				if (i->region->pathfinder_flag) ++i->region->pathfinder_flag;
+				int flag = short_path_region_flags.get(i->region);
+				if (flag) short_path_region_flags.set(i->region, flag + 1);
 				if (!i->visited) {
 					if (i->directional_flags) i->directional_flags = pf_remove_visited_flags(i->pos, i->directional_flags);
 					if (i->directional_flags) {
@@ -10491,11 +10714,12 @@ struct state_functions {
 				n_unvisited_nodes = n_unvisited_destination_region_nodes;
 				for (auto* nr : move_to_region->walkable_neighbors) {
 					if (nr == source_region) continue;
-					if (nr->pathfinder_flag < 2) {
+					int flag = short_path_region_flags.get(nr);
+					if (flag < 2) {
 						++n_unvisited_nodes;
 						break;
 					} else {
-						n_unvisited_nodes -= nr->pathfinder_flag / 2;
+						n_unvisited_nodes -= flag / 2;
 						if (n_unvisited_nodes < 0) n_unvisited_nodes = 0;
 					}
 				}
@@ -10525,7 +10749,7 @@ struct state_functions {
 					if (i->region == destination_region || i->region == target_region) {
 						cost += i->total_cost / 2;
 					} else {
-						if (i->region->pathfinder_flag) {
+						if (short_path_region_flags.get(i->region)) {
 							cost = cost * 3 / 2;
 						} else {
 							if (i->region == source_region) cost *= 2;
@@ -10553,10 +10777,6 @@ struct state_functions {
 			pf.short_path[49] = pf.short_path.back();
 			pf.short_path.resize(50);
 		}
-		for (auto* nr : move_to_region->walkable_neighbors) {
-			if (nr == source_region) continue;
-			nr->pathfinder_flag = 0;
-		}
 	}
 
 	std::pair<bool, xy> pathfinder_adjust_target_pos(rect unit_inner_bb, xy target) const {
@@ -10727,6 +10947,7 @@ struct state_functions {
 	}
 
 	bool pathfinder_find(pathfinder& pf, bool short_path_only = false) {
+		OPENBW_INSTRUMENT_SCOPE(pathfinder_find);
 		pf.source_region = get_region_at(pf.source);
 		pf.destination_region = get_region_at(pf.destination);
 		pf.unit_bb = unit_type_inner_bounding_box(pf.u->unit_type);
@@ -10757,6 +10978,11 @@ struct state_functions {
 			return r;
 		}
 		if (st.paths.size() >= 1024) return nullptr;
+		if (!st.unused_paths.empty()) {
+			st.paths.splice(st.paths.end(), st.unused_paths, st.unused_paths.begin());
+			st.paths.back() = path_t();
+			return &st.paths.back();
+		}
 		return &*st.paths.emplace(st.paths.end());
 	}
 
@@ -12296,6 +12522,59 @@ struct state_functions {
 		return ~st.tiles[tile_index(pos)].explored;
 	}
 
+	void enable_vision_bitboards() {
+		st.vision_bitboards.enabled = true;
+		vision_bitboards_rebuild();
+	}
+
+	void vision_bitboards_rebuild() const {
+		auto& vb = st.vision_bitboards;
+		if (!vb.enabled) return;
+		if (st.tiles.empty()) vb.row_words = 0;
+		else vb.row_words = (game_st.map_tile_width + 63) / 64;
+		size_t height = vb.row_words ? game_st.map_tile_height : 0;
+		for (auto& v : vb.visible) v.assign(vb.row_words * height, 0);
+		for (auto& v : vb.explored) v.assign(vb.row_words * height, 0);
+		for (size_t y = 0; y != height; ++y) {
+			for (size_t x = 0; x != game_st.map_tile_width; ++x) {
+				auto& tile = st.tiles[y * game_st.map_tile_width + x];
+				vision_bitboards_set(x, y, (uint8_t)~tile.visible, (uint8_t)~tile.explored);
+			}
+		}
+	}
+
+	void vision_bitboards_set(size_t tile_x, size_t tile_y, int visible_to, int explored_by) const {
+		auto& vb = st.vision_bitboards;
+		size_t index = tile_y * vb.row_words + tile_x / 64;
+		uint64_t bit = (uint64_t)1 << (tile_x % 64);
+		for (size_t i = 0; i != 8; ++i) {
+			if (visible_to & (1 << i)) vb.visible[i][index] |= bit;
+			if (explored_by & (1 << i)) vb.explored[i][index] |= bit;
+		}
+	}
+
+	// Sets the bit of tile (tile_x, tile_y) in the explored board, and in the
+	// visible board if visible is set, of players[0] to players[players_size - 1].
+	void vision_bitboards_reveal(size_t tile_x, size_t tile_y, const std::array<size_t, 8>& players, size_t players_size, bool visible) const {
+		auto& vb = st.vision_bitboards;
+		size_t index = tile_y * vb.row_words + tile_x / 64;
+		uint64_t bit = (uint64_t)1 << (tile_x % 64);
+		for (size_t i = 0; i != players_size; ++i) {
+			if (visible) vb.visible[players[i]][index] |= bit;
+			vb.explored[players[i]][index] |= bit;
+		}
+	}
+
+	// Makes every tile not visible to anyone.
+	void reset_tile_visibility() {
+		for (auto& v : st.tiles) {
+			v.visible = 0xff;
+		}
+		if (st.vision_bitboards.enabled) {
+			for (auto& v : st.vision_bitboards.visible) std::fill(v.begin(), v.end(), 0);
+		}
+	}
+
 	int get_ground_height_at(xy pos) const {
 		size_t index = tile_index(pos);
 		tile_id tile_id = game_st.gfx_tiles.at(index);
@@ -12309,6 +12588,22 @@ struct state_functions {
 	}
 
 	void reveal_sight_at(xy pos, int range, int reveal_to, bool in_air) {
+		if (defer_sight) {
+			sight_batch->entries.push_back({pos, range, reveal_to, in_air});
+			return;
+		}
+		OPENBW_INSTRUMENT_SCOPE(reveal_sight_at);
+		reveal_sight_at(st.tiles.data(), pos, range, reveal_to, in_air);
+	}
+
+	// Only clears bits of visible and explored in tiles. Ground sight only
+	// propagates past a reached tile that is not higher than pos and whose
+	// reveal_to bits are clear, and this call has already cleared those bits
+	// for every tile it reached, so which tiles are reached depends only on
+	// the height flags of the tiles around pos.
+	// Calls can therefore be made in any order, or on separate copies of the
+	// tiles whose visible and explored are combined with & afterwards.
+	void reveal_sight_at(tile_t* tiles, xy pos, int range, int reveal_to, bool in_air) const {
 		int visibility_mask = ~reveal_to;
 		int height_mask = 0;
 		if (!in_air) {
@@ -12323,7 +12618,15 @@ struct state_functions {
 		const auto& sight_vals = game_st.sight_values.at(range);
 		size_t tile_x = (size_t)pos.x / 32;
 		size_t tile_y = (size_t)pos.y / 32;
-		tile_t* base_tile = &st.tiles[tile_x + tile_y*game_st.map_tile_width];
+		tile_t* base_tile = &tiles[tile_x + tile_y*game_st.map_tile_width];
+		bool update_bitboards = st.vision_bitboards.enabled && tiles == st.tiles.data();
+		std::array<size_t, 8> players;
+		size_t players_size = 0;
+		if (update_bitboards) {
+			for (size_t i = 0; i != 8; ++i) {
+				if (reveal_to & (1 << i)) players[players_size++] = i;
+			}
+		}
 		if (!in_air) {
 			size_t index = 0;
 			size_t end = sight_vals.min_mask_size;
@@ -12335,6 +12638,7 @@ struct state_functions {
 				auto& tile = base_tile[cur.relative_tile_index];
 				tile.visible &= visibility_mask;
 				tile.explored &= visibility_mask;
+				if (update_bitboards) vision_bitboards_reveal(tile_x + cur.x, tile_y + cur.y, players, players_size, true);
 				vision_propagation[index] = (uint32_t)tile.flags << 16 | (uint32_t)tile.explored << 8 | (uint32_t)tile.visible;
 			}
 			end += sight_vals.ext_masked_count;
@@ -12349,6 +12653,7 @@ struct state_functions {
 				auto& tile = base_tile[cur.relative_tile_index];
 				tile.visible &= visibility_mask;
 				tile.explored &= visibility_mask;
+				if (update_bitboards) vision_bitboards_reveal(tile_x + cur.x, tile_y + cur.y, players, players_size, true);
 				vision_propagation[index] = (uint32_t)tile.flags << 16 | (uint32_t)tile.explored << 8 | (uint32_t)tile.visible;
 			}
 		} else {
@@ -12362,10 +12667,152 @@ struct state_functions {
 				auto& tile = base_tile[cur->relative_tile_index];
 				tile.visible &= visibility_mask;
 				tile.explored &= visibility_mask;
+				if (update_bitboards) vision_bitboards_reveal(tile_x + cur->x, tile_y + cur->y, players, players_size, true);
+			}
+		}
+	}
+
+	// Calls f with the index of every tile that reveal_sight_at reveals from
+	// tile (tile_x, tile_y), when it reveals to at least one player. height is
+	// the ground height at the position, or -1 for air units.
+	template<typename F>
+	void for_each_sight_tile(size_t tile_x, size_t tile_y, int range, int height, F&& f) const {
+		const auto& sight_vals = game_st.sight_values.at(range);
+		size_t base_index = tile_x + tile_y * game_st.map_tile_width;
+		if (height != -1) {
+			int height_mask = 0;
+			if (height == 2) height_mask = tile_t::flag_very_high;
+			else if (height == 1) height_mask = tile_t::flag_very_high | tile_t::flag_high;
+			else height_mask = tile_t::flag_very_high | tile_t::flag_high | tile_t::flag_middle;
+			const size_t max_width = 11 * 2 + 3;
+			// Whether sight stops at the tile; it does at tiles that are not
+			// revealed.
+			std::array<bool, max_width * max_width> blocked;
+			size_t index = 0;
+			size_t end = sight_vals.min_mask_size;
+			for (; index != end; ++index) {
+				const auto& cur = sight_vals.maskdat[index];
+				blocked[index] = true;
+				if (tile_x + cur.x >= game_st.map_tile_width) continue;
+				if (tile_y + cur.y >= game_st.map_tile_height) continue;
+				size_t i = base_index + cur.relative_tile_index;
+				f(i);
+				blocked[index] = (st.tiles[i].flags & height_mask) != 0;
+			}
+			end += sight_vals.ext_masked_count;
+			for (; index != end; ++index) {
+				const auto& cur = sight_vals.maskdat[index];
+				blocked[index] = true;
+				if (tile_x + cur.x >= game_st.map_tile_width) continue;
+				if (tile_y + cur.y >= game_st.map_tile_height) continue;
+				if (blocked[cur.prev]) {
+					if (cur.prev2 == (size_t)~0 || blocked[cur.prev2]) continue;
+				}
+				size_t i = base_index + cur.relative_tile_index;
+				f(i);
+				blocked[index] = (st.tiles[i].flags & height_mask) != 0;
+			}
+		} else {
+			auto* cur = sight_vals.maskdat.data();
+			auto* end = cur + sight_vals.ext_masked_count;
+			for (; cur != end; ++cur) {
+				if (tile_x + cur->x >= game_st.map_tile_width) continue;
+				if (tile_y + cur->y >= game_st.map_tile_height) continue;
+				f(base_index + cur->relative_tile_index);
 			}
 		}
 	}
 
+	// Starts maintaining st.incremental_vision. The sight of every unit is
+	// counted the next time update_tiles is set.
+	void enable_incremental_vision() {
+		st.incremental_vision.enabled = true;
+		incremental_vision_reset();
+	}
+
+	void incremental_vision_reset() {
+		auto& iv = st.incremental_vision;
+		if (!iv.enabled) return;
+		iv.generation = 0;
+		iv.sources.assign(decltype(st.units_container)::capacity, {});
+		iv.counts.assign(st.tiles.size(), {});
+		iv.visible_to.assign(st.tiles.size(), 0);
+	}
+
+	void incremental_vision_count(const incremental_vision_t::source& s, bool add) {
+		auto& iv = st.incremental_vision;
+		size_t width = game_st.map_tile_width;
+		bool update_bitboards = st.vision_bitboards.enabled;
+		std::array<size_t, 8> players;
+		size_t players_size = 0;
+		for (size_t i = 0; i != 8; ++i) {
+			if (s.reveal_to & (1 << i)) players[players_size++] = i;
+		}
+		size_t tile_x = (size_t)s.tile_index % width;
+		size_t tile_y = (size_t)s.tile_index / width;
+		if (add) {
+			for_each_sight_tile(tile_x, tile_y, s.range, s.height, [&](size_t index) {
+				auto& counts = iv.counts[index];
+				for (size_t i = 0; i != players_size; ++i) {
+					if (counts[players[i]]++ == 0) iv.visible_to[index] |= 1 << players[i];
+				}
+				st.tiles[index].explored &= ~s.reveal_to;
+				if (update_bitboards) vision_bitboards_reveal(index % width, index / width, players, players_size, false);
+			});
+		} else {
+			for_each_sight_tile(tile_x, tile_y, s.range, s.height, [&](size_t index) {
+				auto& counts = iv.counts[index];
+				for (size_t i = 0; i != players_size; ++i) {
+					if (--counts[players[i]] == 0) iv.visible_to[index] &= ~(1 << players[i]);
+				}
+			});
+		}
+	}
+
+	// Counts the sight of u as a source in st.incremental_vision, replacing
+	// the sight it was last counted with if anything changed.
+	void incremental_vision_refresh(const unit_t* u, xy pos, int range, int reveal_to, bool in_air) {
+		auto& iv = st.incremental_vision;
+		auto& s = iv.sources[u->index];
+		if (s.generation == iv.generation) {
+			reveal_sight_at(pos, range, reveal_to, in_air);
+			return;
+		}
+		incremental_vision_t::source n;
+		n.generation = iv.generation;
+		// Sight that is not revealed to any player does not change any tiles.
+		if (reveal_to & 0xff) {
+			n.tile_index = (int)tile_index(pos);
+			n.range = range;
+			n.reveal_to = reveal_to & 0xff;
+			n.height = in_air ? -1 : get_ground_height_at(pos);
+		}
+		if (n.tile_index != s.tile_index || n.range != s.range || n.reveal_to != s.reveal_to || n.height != s.height) {
+			if (s.tile_index != -1) incremental_vision_count(s, false);
+			if (n.tile_index != -1) incremental_vision_count(n, true);
+			s = n;
+		} else s.generation = iv.generation;
+	}
+
+	// Removes the sources that were not counted since count_sight was set, and
+	// reveals the sight of the rest.
+	void incremental_vision_apply() {
+		auto& iv = st.incremental_vision;
+		for (auto& s : iv.sources) {
+			if (s.tile_index == -1 || s.generation == iv.generation) continue;
+			incremental_vision_count(s, false);
+			s = {};
+		}
+		size_t width = game_st.map_tile_width;
+		bool update_bitboards = st.vision_bitboards.enabled;
+		for (size_t i = 0; i != st.tiles.size(); ++i) {
+			int visible_to = iv.visible_to[i];
+			if (!visible_to) continue;
+			st.tiles[i].visible &= ~visible_to;
+			if (update_bitboards) vision_bitboards_set(i % width, i / width, visible_to, 0);
+		}
+	}
+
 	void refresh_unit_vision(unit_t* u) {
 		if (u->owner >= 8 && !u->parasite_flags) return;
 		if (unit_is(u, UnitTypes::Terran_Nuclear_Missile)) return;
@@ -12381,7 +12828,8 @@ struct state_functions {
 				}
 			}
 		}
-		reveal_sight_at(u->sprite->position, unit_sight_range(u) / 32u, visible_to, u_flying(u));
+		if (count_sight) incremental_vision_refresh(u, u->sprite->position, unit_sight_range(u) / 32u, visible_to, u_flying(u));
+		else reveal_sight_at(u->sprite->position, unit_sight_range(u) / 32u, visible_to, u_flying(u));
 	}
 
 	void turn_turret(unit_t* u, direction_t turn) {
@@ -12492,7 +12940,7 @@ struct state_functions {
 		auto* t = create_thingy(sprite, u->sprite->position + offset, 0);
 		if (t) {
 			t->sprite->elevation_level = u->sprite->elevation_level + 1;
-			if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+			update_thingy_sprite_visibility(t);
 			for (image_t* i : ptr(t->sprite->images)) {
 				set_image_heading(i, heading);
 			}
@@ -12900,64 +13348,106 @@ struct state_functions {
 
 		update_disruption_web();
 
-		for (auto i = st.dead_units.begin(); i != st.dead_units.end();) {
-			unit_t* u = &*i++;
-			iscript_flingy = u;
-			iscript_unit = u;
-			update_dead_unit(u);
+		{
+			OPENBW_INSTRUMENT_SCOPE(update_units_dead);
+			for (auto i = st.dead_units.begin(); i != st.dead_units.end();) {
+				unit_t* u = &*i++;
+				iscript_flingy = u;
+				iscript_unit = u;
+				update_dead_unit(u);
+			}
 		}
 
-		for (unit_t* u : ptr(st.visible_units)) {
-			iscript_flingy = u;
-			iscript_unit = u;
-			update_unit_movement(u);
+		// The game logic does not look at the visibility of tiles while units
+		// move, so the sight revealed until the end of the map revealer loop
+		// can be applied in one batch.
+		defer_sight = sight_batch != nullptr;
+		defer_unit_finder_reinsert = batch_unit_finder_reinsert;
+		// Likewise, the sight of units that is revealed now can be counted and
+		// only the changes propagated.
+		count_sight = update_tiles && st.incremental_vision.enabled;
+		if (count_sight) ++st.incremental_vision.generation;
+
+		{
+			OPENBW_INSTRUMENT_SCOPE(update_units_movement);
+			for (unit_t* u : ptr(st.visible_units)) {
+				iscript_flingy = u;
+				iscript_unit = u;
+				update_unit_movement(u);
+			}
 		}
 
+		defer_unit_finder_reinsert = false;
+		unit_finder_flush();
+
 		if (update_tiles) {
 			for (unit_t* u : ptr(st.map_revealer_units)) {
 				refresh_unit_vision(u);
 			}
 		}
 
-		for (unit_t* u : ptr(st.visible_units)) {
-			update_unit_sprite(u);
-			if (u_cloaked(u) || u_requires_detector(u)) {
-				u->cloak_counter = 0;
-				if (u->secondary_order_timer) --u->secondary_order_timer;
-				else {
-					update_unit_detected_flags(u);
-					u->secondary_order_timer = 30;
+		if (count_sight) {
+			count_sight = false;
+			incremental_vision_apply();
+		}
+
+		if (defer_sight) {
+			defer_sight = false;
+			sight_batch->apply(*this);
+			sight_batch->entries.clear();
+		}
+
+		{
+			OPENBW_INSTRUMENT_SCOPE(update_units_sprites);
+			for (unit_t* u : ptr(st.visible_units)) {
+				update_unit_sprite(u);
+				if (u_cloaked(u) || u_requires_detector(u)) {
+					u->cloak_counter = 0;
+					if (u->secondary_order_timer) --u->secondary_order_timer;
+					else {
+						update_unit_detected_flags(u);
+						u->secondary_order_timer = 30;
+					}
 				}
 			}
 		}
 
-		for (auto i = st.visible_units.begin(); i != st.visible_units.end();) {
-			unit_t* u = &*i++;
-			iscript_flingy = u;
-			iscript_unit = u;
-			update_unit(u);
+		{
+			OPENBW_INSTRUMENT_SCOPE(update_units_update);
+			for (auto i = st.visible_units.begin(); i != st.visible_units.end();) {
+				unit_t* u = &*i++;
+				iscript_flingy = u;
+				iscript_unit = u;
+				update_unit(u);
+			}
 		}
 
-		for (auto i = st.hidden_units.begin(); i != st.hidden_units.end();) {
-			unit_t* u = &*i++;
-			if (u_cloaked(u) || u_requires_detector(u)) u->cloak_counter = 0;
-			iscript_flingy = u;
-			iscript_unit = u;
-			update_hidden_unit(u);
+		{
+			OPENBW_INSTRUMENT_SCOPE(update_units_hidden);
+			for (auto i = st.hidden_units.begin(); i != st.hidden_units.end();) {
+				unit_t* u = &*i++;
+				if (u_cloaked(u) || u_requires_detector(u)) u->cloak_counter = 0;
+				iscript_flingy = u;
+				iscript_unit = u;
+				update_hidden_unit(u);
+			}
 		}
 
-		for (auto i = st.cloaked_units.begin(); i != st.cloaked_units.end();) {
-			unit_t* u = &*i++;
-			if (u->cloak_counter == 0) {
-				st.cloaked_units.remove(*u);
-				u->cloaked_unit_link = {nullptr, nullptr};
-				u_unset_status_flag(u, unit_t::status_flag_passively_cloaked);
-				decloak_unit(u);
-			} else {
-				if (!u_burrowed(u) && u->secondary_order_type->id == Orders::Cloak && u->cloak_counter == 1 && u_passively_cloaked(u)) {
+		{
+			OPENBW_INSTRUMENT_SCOPE(update_units_cloaked);
+			for (auto i = st.cloaked_units.begin(); i != st.cloaked_units.end();) {
+				unit_t* u = &*i++;
+				if (u->cloak_counter == 0) {
+					st.cloaked_units.remove(*u);
+					u->cloaked_unit_link = {nullptr, nullptr};
 					u_unset_status_flag(u, unit_t::status_flag_passively_cloaked);
+					decloak_unit(u);
+				} else {
+					if (!u_burrowed(u) && u->secondary_order_type->id == Orders::Cloak && u->cloak_counter == 1 && u_passively_cloaked(u)) {
+						u_unset_status_flag(u, unit_t::status_flag_passively_cloaked);
+					}
+					if (!u_requires_detector(u)) cloak_unit(u);
 				}
-				if (!u_requires_detector(u)) cloak_unit(u);
 			}
 		}
 
@@ -12966,11 +13456,14 @@ struct state_functions {
 		st.recent_lurker_hit_current_index = (st.recent_lurker_hit_current_index + 1) % st.recent_lurker_hits.size();
 		st.recent_lurker_hits[st.recent_lurker_hit_current_index].clear();
 
-		for (auto i = st.map_revealer_units.begin(); i != st.map_revealer_units.end();) {
-			unit_t* u = &*i++;
-			iscript_flingy = u;
-			iscript_unit = u;
-			update_unit(u);
+		{
+			OPENBW_INSTRUMENT_SCOPE(update_units_map_revealers);
+			for (auto i = st.map_revealer_units.begin(); i != st.map_revealer_units.end();) {
+				unit_t* u = &*i++;
+				iscript_flingy = u;
+				iscript_unit = u;
+				update_unit(u);
+			}
 		}
 
 		iscript_flingy = nullptr;
@@ -12984,7 +13477,7 @@ struct state_functions {
 			iscript_bullet = b;
 			iscript_flingy = b;
 			if (b->sprite) {
-				if (!us_hidden(b)) set_sprite_visibility(b->sprite, tile_visibility(b->sprite->position));
+				update_thingy_sprite_visibility(b);
 				if (!iscript_execute_sprite(b->sprite)) b->sprite = nullptr;
 			}
 			if (!b->sprite && b->bullet_state != bullet_t::state_dying) error("non-dying bullet has null sprite");
@@ -13002,8 +13495,10 @@ struct state_functions {
 	}
 
 	void update_thingy(thingy_t* t) {
+#ifndef OPENBW_HEADLESS
 		if (sprite_is_doodad(t->sprite->sprite_type)) set_sprite_visibility(t->sprite, ~0);
-		else if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+		else update_thingy_sprite_visibility(t);
+#endif
 		if (!iscript_execute_sprite(t->sprite)) {
 			t->sprite = nullptr;
 			--st.active_thingies_size;
@@ -13092,11 +13587,7 @@ struct state_functions {
 		--st.update_tiles_countdown;
 		update_tiles = st.update_tiles_countdown == 0;
 
-		if (update_tiles) {
-			for (auto& v : st.tiles) {
-				v.visible = 0xff;
-			}
-		}
+		if (update_tiles) reset_tile_visibility();
 
 		update_units();
 		update_bullets();
@@ -13190,6 +13681,7 @@ struct state_functions {
 
 	void next_frame() {
 		++st.current_frame;
+		OPENBW_INSTRUMENT_BEGIN_FRAME(st.current_frame);
 		process_frame();
 		process_triggers();
 	}
@@ -13239,10 +13731,27 @@ struct state_functions {
 		sprite->visibility_flags = visibility_flags;
 	}
 
+	// Only the visibility of unit sprites is used by the game logic; for
+	// thingies and bullets it is only used for drawing. When OPENBW_HEADLESS
+	// is defined this, the redraw flag and play_sound are skipped. Everything
+	// else (thingy iscripts, image frames and headings) has to run, since
+	// iscripts draw from lcg_rand and image frames determine lo offsets.
+	void update_thingy_sprite_visibility(thingy_t* t) {
+#ifndef OPENBW_HEADLESS
+		if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+#endif
+	}
+
+	void set_image_redraw(image_t* image) {
+#ifndef OPENBW_HEADLESS
+		image->flags |= image_t::flag_redraw;
+#endif
+	}
+
 	void set_image_offset(image_t* image, xy offset) {
 		if (image->offset == offset) return;
 		image->offset = offset;
-		image->flags |= image_t::flag_redraw;
+		set_image_redraw(image);
 	}
 
 	void set_image_modifier(image_t* image, int modifier) {
@@ -13251,13 +13760,13 @@ struct state_functions {
 			image->modifier_data1 = 48;
 			image->modifier_data2 = 2;
 		}
-		image->flags |= image_t::flag_redraw;
+		set_image_redraw(image);
 	}
 
 	void show_image(image_t* image) {
 		if (~image->flags&image_t::flag_hidden) return;
 		image->flags &= ~image_t::flag_hidden;
-		image->flags |= image_t::flag_redraw;
+		set_image_redraw(image);
 	}
 
 	void hide_image(image_t* image) {
@@ -13273,7 +13782,7 @@ struct state_functions {
 		size_t frame_index = image->frame_index_base + image->frame_index_offset;
 		if (image->frame_index != frame_index) {
 			image->frame_index = frame_index;
-			image->flags |= image_t::flag_redraw;
+			set_image_redraw(image);
 		}
 	}
 
@@ -13933,7 +14442,7 @@ struct state_functions {
 	void ensnare(xy pos, const unit_t* source_unit) {
 		thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Ensnare), pos, 0);
 		t->sprite->elevation_level = 19;
-		if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+		update_thingy_sprite_visibility(t);
 		for (unit_t* target : find_units_noexpand(square_at(pos, 64))) {
 			if (target == source_unit) continue;
 			if (ut_building(target)) continue;
@@ -14000,7 +14509,7 @@ struct state_functions {
 		thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Stasis_Field_Hit), pos, 0);
 		if (t) {
 			t->sprite->elevation_level = 17;
-			if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+			update_thingy_sprite_visibility(t);
 		}
 		for (unit_t* target : find_units_noexpand(square_at(pos, 48))) {
 			if (target == source_unit) continue;
@@ -14023,7 +14532,7 @@ struct state_functions {
 		thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Maelstrom_Hit), pos, 0);
 		if (t) {
 			t->sprite->elevation_level = 17;
-			if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+			update_thingy_sprite_visibility(t);
 		}
 		play_sound(1064, source_unit);
 		for (unit_t* target : find_units_noexpand(square_at(pos, 48))) {
@@ -14338,6 +14847,7 @@ struct state_functions {
 	}
 
 	void bullet_execute(bullet_t* b) {
+		OPENBW_INSTRUMENT_SCOPE(bullet_execute);
 		execute_movement_struct ems;
 		while (true) {
 			bool cont = false;
@@ -14540,6 +15050,11 @@ struct state_functions {
 			return r;
 		}
 		if (st.thingies.size() >= 500) return nullptr;
+		if (!st.unused_thingies.empty()) {
+			st.thingies.splice(st.thingies.end(), st.unused_thingies, st.unused_thingies.begin());
+			st.thingies.back() = thingy_t();
+			return &st.thingies.back();
+		}
 		return &*st.thingies.emplace(st.thingies.end());
 	}
 
@@ -14566,7 +15081,7 @@ struct state_functions {
 		thingy_t* t = create_thingy(sprite_type, parent_image->sprite->position + parent_image->offset + offset, 0);
 		if (!t) return nullptr;
 		t->sprite->elevation_level = elevation_level;
-		if (!us_hidden(t)) set_sprite_visibility(t->sprite, tile_visibility(t->sprite->position));
+		update_thingy_sprite_visibility(t);
 		return t;
 	}
 
@@ -14636,6 +15151,7 @@ struct state_functions {
 	}
 
 	bool iscript_execute(image_t* image, iscript_state_t& state, bool noop = false, fp8* distance_moved = nullptr, bool allow_main_image_destruction = false) {
+		OPENBW_INSTRUMENT_SCOPE(iscript_execute);
 		if (state.wait) {
 			--state.wait;
 			return true;
@@ -14735,7 +15251,7 @@ struct state_functions {
 				if (noop) break;
 				if (image->offset.x != a) {
 					image->offset.x = a;
-					image->flags |= image_t::flag_redraw;
+					set_image_redraw(image);
 				}
 				break;
 			case opc_setvertpos:
@@ -14744,7 +15260,7 @@ struct state_functions {
 				if (!iscript_unit || (!u_requires_detector(iscript_unit) && !u_cloaked(iscript_unit))) {
 					if (image->offset.y != a) {
 						image->offset.y = a;
-						image->flags |= image_t::flag_redraw;
+						set_image_redraw(image);
 					}
 				}
 				break;
@@ -15483,6 +15999,80 @@ struct state_functions {
 		if (st.unit_counts[u->owner][u->unit_type->id] < 0) st.unit_counts[u->owner][u->unit_type->id] = 0;
 	}
 
+	// Starts maintaining st.unit_soa, filling it in from the current units.
+	void enable_unit_soa() {
+		st.unit_soa.enabled = true;
+		unit_soa_reset();
+		for (auto* list : {&st.visible_units, &st.hidden_units, &st.map_revealer_units}) {
+			for (unit_t* u : ptr(*list)) unit_soa_update_bounding_box(u);
+		}
+	}
+
+	// Makes st.unit_soa hold no units.
+	void unit_soa_reset() {
+		auto& soa = st.unit_soa;
+		if (!soa.enabled) return;
+		size_t n = decltype(st.units_container)::capacity;
+		for (auto* v : {&soa.from_x, &soa.from_y, &soa.to_x, &soa.to_y}) v->assign(n, -1);
+	}
+
+	void unit_soa_update_bounding_box(const unit_t* u) {
+		auto& soa = st.unit_soa;
+		if (!soa.enabled) return;
+		size_t i = u->index;
+		soa.from_x[i] = u->unit_finder_bounding_box.from.x;
+		soa.from_y[i] = u->unit_finder_bounding_box.from.y;
+		soa.to_x[i] = u->unit_finder_bounding_box.to.x;
+		soa.to_y[i] = u->unit_finder_bounding_box.to.y;
+	}
+
+	// Calls f with the index of every unit find_units(area) would return, by
+	// testing every unit in st.unit_soa, which must be enabled. The units are
+	// visited in index order rather than unit finder order, so this can only
+	// replace find_units where the order does not matter.
+	template<typename F>
+	void unit_soa_find_units(rect area, F&& f) const {
+		auto& soa = st.unit_soa;
+		int begin_x = area.from.x;
+		int end_x = area.to.x;
+		if (end_x - begin_x + 1 < game_st.max_unit_width) {
+			end_x = begin_x + game_st.max_unit_width - 1;
+			++area.to.x;
+		}
+		if (area.to.y - area.from.y + 1 < game_st.max_unit_height) ++area.to.y;
+		const int* from_x = soa.from_x.data();
+		const int* from_y = soa.from_y.data();
+		const int* to_x = soa.to_x.data();
+		const int* to_y = soa.to_y.data();
+		size_t n = soa.from_x.size();
+		// The tests are written without branches so that each block of units
+		// is tested as vectors, and only the units that pass are visited.
+		const size_t block_size = 64;
+		std::array<uint8_t, block_size> match;
+		for (size_t block_begin = 0; block_begin < n; block_begin += block_size) {
+			size_t block_n = std::min(block_size, n - block_begin);
+			for (size_t i = 0; i != block_n; ++i) {
+				size_t index = block_begin + i;
+				int fx = from_x[index];
+				int tx = to_x[index];
+				bool from_in_range = (fx >= begin_x) & (fx < end_x);
+				bool to_in_range = (tx >= begin_x) & (tx < end_x);
+				bool in_bounds = (fx < area.to.x) & (from_y[index] < area.to.y) & (to_y[index] >= area.from.y);
+				match[i] = (from_in_range | to_in_range) & in_bounds & (tx != -1);
+			}
+			std::fill(match.begin() + block_n, match.end(), 0);
+			// Most units do not match, so eight results are skipped at once.
+			for (size_t i = 0; i != block_size; i += 8) {
+				uint64_t any;
+				memcpy(&any, match.data() + i, 8);
+				if (!any) continue;
+				for (size_t j = i; j != i + 8; ++j) {
+					if (match[j]) f(block_begin + j);
+				}
+			}
+		}
+	}
+
 	void unit_finder_insert(unit_t* u) {
 		if (ut_turret(u)) return;
 
@@ -15498,12 +16088,13 @@ struct state_functions {
 
 	void unit_finder_remove(unit_t* u) {
 		if (u->unit_finder_bounding_box.to.x == -1) return;
-		if (unit_finder_search_index) error("attempt to modify unit finder while search is active");
+		if (unit_finder_active_searches) error("attempt to modify unit finder while search is active");
+		unit_finder_flush();
 		auto remove = [&](auto& vec, int value) {
 			auto cmp_l = [&](auto& a, int b) {
 				return a.value < b;
 			};
-			auto i = std::lower_bound(vec.begin(), vec.end(), value, cmp_l);
+			auto i = vec.lower_bound(value, cmp_l);
 			while (i->u != u) ++i;
 			vec.erase(i);
 		};
@@ -15512,31 +16103,47 @@ struct state_functions {
 		remove(st.unit_finder_y, u->unit_finder_bounding_box.from.y);
 		remove(st.unit_finder_y, u->unit_finder_bounding_box.to.y);
 		u->unit_finder_bounding_box = {{-1, -1}, {-1, -1}};
+		unit_soa_update_bounding_box(u);
 	}
 
 	void unit_finder_insert(unit_t* u, rect bb) {
-		if (unit_finder_search_index) error("attempt to modify unit finder while search is active");
+		if (unit_finder_active_searches) error("attempt to modify unit finder while search is active");
+		unit_finder_flush();
 		auto insert = [&](auto& vec, int from_value, int to_value) {
 			auto cmp_l = [&](auto& a, int b) {
 				return a.value < b;
 			};
-			auto from_i = std::lower_bound(vec.begin(), vec.end(), from_value, cmp_l);
+			auto from_i = vec.lower_bound(from_value, cmp_l);
 			vec.insert(from_i, {u, from_value});
-			auto to_i = std::lower_bound(vec.begin(), vec.end(), to_value, cmp_l);
+			auto to_i = vec.lower_bound(to_value, cmp_l);
 			vec.insert(to_i, {u, to_value});
 		};
 		insert(st.unit_finder_x, bb.from.x, bb.to.x);
 		insert(st.unit_finder_y, bb.from.y, bb.to.y);
 		u->unit_finder_bounding_box = bb;
+		unit_soa_update_bounding_box(u);
 	}
 	void unit_finder_reinsert(unit_t* u, rect bb) {
-		if (unit_finder_search_index) error("attempt to modify unit finder while search is active");
+		if (unit_finder_active_searches) error("attempt to modify unit finder while search is active");
+		if (defer_unit_finder_reinsert) {
+			if (unit_finder_is_pending(u)) unit_finder_flush();
+			if (u->index >= unit_finder_pending_index.size()) unit_finder_pending_index.resize(u->index + 1);
+			unit_finder_pending.push_back({u, u->unit_finder_bounding_box, bb});
+			unit_finder_pending_index[u->index] = unit_finder_pending.size();
+		} else {
+			unit_finder_move_entries(u, u->unit_finder_bounding_box, bb);
+		}
+		u->unit_finder_bounding_box = bb;
+		unit_soa_update_bounding_box(u);
+	}
+
+	void unit_finder_move_entries(unit_t* u, rect old_bb, rect bb) const {
 		auto reinsert = [&](auto& vec, int old_value, int new_value) {
 			if (old_value == new_value) return;
 			auto cmp_l = [&](auto& a, int b) {
 				return a.value < b;
 			};
-			auto i = std::lower_bound(vec.begin(), vec.end(), old_value, cmp_l);
+			auto i = vec.lower_bound(old_value, cmp_l);
 			while (i->u != u) ++i;
 			if (new_value > old_value) {
 				auto ni = std::next(i);
@@ -15559,23 +16166,149 @@ struct state_functions {
 				*i = {u, new_value};
 			}
 		};
-		if (bb.from.x <= u->unit_finder_bounding_box.from.x) {
-			reinsert(st.unit_finder_x, u->unit_finder_bounding_box.from.x, bb.from.x);
-			reinsert(st.unit_finder_x, u->unit_finder_bounding_box.to.x, bb.to.x);
+		if (bb.from.x <= old_bb.from.x) {
+			reinsert(st.unit_finder_x, old_bb.from.x, bb.from.x);
+			reinsert(st.unit_finder_x, old_bb.to.x, bb.to.x);
 		} else {
-			reinsert(st.unit_finder_x, u->unit_finder_bounding_box.to.x, bb.to.x);
-			reinsert(st.unit_finder_x, u->unit_finder_bounding_box.from.x, bb.from.x);
+			reinsert(st.unit_finder_x, old_bb.to.x, bb.to.x);
+			reinsert(st.unit_finder_x, old_bb.from.x, bb.from.x);
 		}
-		if (bb.from.y <= u->unit_finder_bounding_box.from.y) {
-			reinsert(st.unit_finder_y, u->unit_finder_bounding_box.from.y, bb.from.y);
-			reinsert(st.unit_finder_y, u->unit_finder_bounding_box.to.y, bb.to.y);
+		if (bb.from.y <= old_bb.from.y) {
+			reinsert(st.unit_finder_y, old_bb.from.y, bb.from.y);
+			reinsert(st.unit_finder_y, old_bb.to.y, bb.to.y);
 		} else {
-			reinsert(st.unit_finder_y, u->unit_finder_bounding_box.to.y, bb.to.y);
-			reinsert(st.unit_finder_y, u->unit_finder_bounding_box.from.y, bb.from.y);
+			reinsert(st.unit_finder_y, old_bb.to.y, bb.to.y);
+			reinsert(st.unit_finder_y, old_bb.from.y, bb.from.y);
+		}
+	}
+
+	// While defer_unit_finder_reinsert is set (the movement loop of update_units
+	// if batch_unit_finder_reinsert is set), unit_finder_reinsert only updates
+	// unit_finder_bounding_box and records the move. The entries in
+	// unit_finder_x and unit_finder_y are updated by unit_finder_flush, which
+	// is called before anything reads them:
+	//   unit_finder_search (find_units, find_unit and their _noexpand versions),
+	//   find_nearest_unit, check_unit_movement_unit_collision, the local unit
+	//   edges of the pathfinder, unit_finder_insert, unit_finder_remove and
+	//   unit_finder_reinsert of a unit that already has a move recorded.
+	// Ground units that move flush before checking for collisions, so batches
+	// are only large when most of the units that move are not ground units;
+	// unit_finder_flushes counts the flushes.
+	// Code that only looks at unit_finder_bounding_box sees the new box right
+	// away, as before. Nothing is recorded outside of the movement loop, so
+	// state copies, snapshots, serialization and hashing always see complete
+	// lists.
+	//
+	// The flushed lists are identical to reinserting each unit when it moved:
+	// every entry moves at most once per flush, and unit_finder_move_entries
+	// puts an entry whose value increases before all other entries with the
+	// new value, and one whose value decreases after them, leaving the order
+	// of all other entries unchanged. So within the entries of one value, those
+	// that moved up come first, last move first, then the entries that did not
+	// move, then those that moved down, first move first. A few moves are
+	// applied one by one; many are applied by giving every entry that rank and
+	// sorting the lists by value and rank with one insertion sort, which costs
+	// one pass plus the same element moves as reinserting one at a time, but
+	// does no searches.
+	struct unit_finder_pending_move {
+		unit_t* u;
+		rect old_bb;
+		rect bb;
+	};
+	mutable a_vector<unit_finder_pending_move> unit_finder_pending;
+	// Index + 1 in unit_finder_pending, by unit index.
+	mutable a_vector<size_t> unit_finder_pending_index;
+	struct unit_finder_merge_entry {
+		state::unit_finder_entry e;
+		ptrdiff_t rank;
+	};
+	mutable a_vector<unit_finder_merge_entry> unit_finder_merge_entries;
+	mutable a_vector<bool> unit_finder_merge_seen;
+
+	bool unit_finder_is_pending(const unit_t* u) const {
+		return u->index < unit_finder_pending_index.size() && unit_finder_pending_index[u->index];
+	}
+
+	template<typename F>
+	void unit_finder_merge_moves(state::unit_finder_list& list, F&& values) const {
+		auto& entries = unit_finder_merge_entries;
+		entries.clear();
+		unit_finder_merge_seen.assign(unit_finder_pending.size(), false);
+		for (auto& e : list) {
+			if (!unit_finder_is_pending(e.u)) {
+				entries.push_back({e, 0});
+				continue;
+			}
+			size_t index = unit_finder_pending_index[e.u->index] - 1;
+			auto& p = unit_finder_pending[index];
+			auto old_values = values(p.old_bb);
+			auto new_values = values(p.bb);
+			// The moves of the from and to entries, in the order
+			// unit_finder_move_entries does them, and the order of each move
+			// among all moves of this flush.
+			bool from_first = new_values.first <= old_values.first;
+			std::array<bool, 2> is_from = {from_first, !from_first};
+			std::array<ptrdiff_t, 2> n = {(ptrdiff_t)index * 2 + 1, (ptrdiff_t)index * 2 + 2};
+			size_t op;
+			if (old_values.first != old_values.second) {
+				op = (e.value == old_values.first) == is_from[0] ? 0 : 1;
+			} else {
+				// Both entries are equal, and each move takes the first one that
+				// has not moved yet.
+				auto moves = [&](size_t op) {
+					return is_from[op] ? new_values.first != old_values.first : new_values.second != old_values.second;
+				};
+				op = moves(0) ? 0 : 1;
+				if (unit_finder_merge_seen[index]) op = op == 0 && moves(1) ? 1 : 2;
+				unit_finder_merge_seen[index] = true;
+			}
+			int new_value = op == 2 ? e.value : is_from[op] ? new_values.first : new_values.second;
+			if (new_value == e.value) entries.push_back({e, 0});
+			else entries.push_back({{e.u, new_value}, new_value > e.value ? -n[op] : n[op]});
+		}
+		auto less = [&](const unit_finder_merge_entry& a, const unit_finder_merge_entry& b) {
+			if (a.e.value != b.e.value) return a.e.value < b.e.value;
+			return a.rank < b.rank;
+		};
+		for (size_t i = 1; i < entries.size(); ++i) {
+			if (!less(entries[i], entries[i - 1])) continue;
+			auto v = entries[i];
+			size_t j = i;
+			do {
+				entries[j] = entries[j - 1];
+				--j;
+			} while (j && less(v, entries[j - 1]));
+			entries[j] = v;
+		}
+		auto i = list.begin();
+		for (auto& v : entries) {
+			*i = v.e;
+			++i;
 		}
-		u->unit_finder_bounding_box = bb;
 	}
 
+	// The number of flushes that applied moves, and the number of moves they
+	// applied.
+	mutable size_t unit_finder_flushes = 0;
+	mutable size_t unit_finder_flushed_moves = 0;
+
+	void unit_finder_flush() const {
+		if (unit_finder_pending.empty()) return;
+		++unit_finder_flushes;
+		unit_finder_flushed_moves += unit_finder_pending.size();
+		if (unit_finder_pending.size() * 16 < st.unit_finder_x.size()) {
+			for (auto& v : unit_finder_pending) unit_finder_move_entries(v.u, v.old_bb, v.bb);
+		} else {
+			unit_finder_merge_moves(st.unit_finder_x, [&](rect bb) {
+				return std::make_pair(bb.from.x, bb.to.x);
+			});
+			unit_finder_merge_moves(st.unit_finder_y, [&](rect bb) {
+				return std::make_pair(bb.from.y, bb.to.y);
+			});
+		}
+		for (auto& v : unit_finder_pending) unit_finder_pending_index[v.u->index] = 0;
+		unit_finder_pending.clear();
+	}
 
 	struct unit_finder_search {
 		using value_type = unit_t*;
@@ -15585,9 +16318,9 @@ struct state_functions {
 			using iterator_category = std::forward_iterator_tag;
 		private:
 			const unit_finder_search* search;
-			a_vector<state::unit_finder_entry>::iterator i;
+			state::unit_finder_list::iterator i;
 			friend unit_finder_search;
-			iterator(const unit_finder_search* search, a_vector<state::unit_finder_entry>::iterator i) : search(search), i(i) {}
+			iterator(const unit_finder_search* search, state::unit_finder_list::iterator i) : search(search), i(i) {}
 			bool in_bounds() {
 				unit_t* u = i->u;
 				if (u->unit_finder_bounding_box.from.x >= search->area.to.x) return false;
@@ -15595,6 +16328,22 @@ struct state_functions {
 				if (u->unit_finder_bounding_box.to.y < search->area.from.y) return false;
 				return true;
 			}
+			// A unit has two entries in unit_finder_x, at from.x and to.x, and is
+			// returned at the first one in the search range. The from.x entry comes
+			// first unless the two are equal, and is in range if from.x >= begin_x.
+			bool first_entry() {
+				unit_t* u = i->u;
+				if (i->value != u->unit_finder_bounding_box.to.x) return true;
+				if (u->unit_finder_bounding_box.from.x != u->unit_finder_bounding_box.to.x) {
+					return u->unit_finder_bounding_box.from.x < search->begin_x;
+				}
+				for (auto prev = i; prev != search->i_begin;) {
+					--prev;
+					if (prev->value != i->value) break;
+					if (prev->u == u) return false;
+				}
+				return true;
+			}
 		public:
 
 			unit_t* operator*() const {
@@ -15609,8 +16358,7 @@ struct state_functions {
 				do {
 					++i;
 					if (i == search->i_end) return *this;
-				} while (!in_bounds() || i->u->unit_finder_visited[search->search_index]);
-				i->u->unit_finder_visited[search->search_index] = true;
+				} while (!in_bounds() || !first_entry());
 				return *this;
 			}
 
@@ -15631,19 +16379,18 @@ struct state_functions {
 	private:
 		friend state_functions;
 		const state_functions& funcs;
-		a_vector<state::unit_finder_entry>::iterator i_begin;
-		a_vector<state::unit_finder_entry>::iterator i_end;
+		state::unit_finder_list::iterator i_begin;
+		state::unit_finder_list::iterator i_end;
 		rect area;
-		size_t search_index;
+		int begin_x;
 		unit_finder_search(const state_functions& funcs, rect area, bool expand) : funcs(funcs), area(area) {
-			if (funcs.unit_finder_search_index == 4) error("unit_finder_search maximum recursive depth reached");
-			search_index = funcs.unit_finder_search_index;
-			++funcs.unit_finder_search_index;
+			funcs.unit_finder_flush();
+			++funcs.unit_finder_active_searches;
 
 			auto cmp_l = [&](auto& a, int b) {
 				return a.value < b;
 			};
-			int begin_x = area.from.x;
+			begin_x = area.from.x;
 			int end_x = area.to.x;
 			if (expand) {
 				if (end_x - begin_x + 1 < funcs.game_st.max_unit_width) {
@@ -15654,23 +16401,17 @@ struct state_functions {
 					++this->area.to.y;
 				}
 			}
-			i_begin = std::lower_bound(funcs.st.unit_finder_x.begin(), funcs.st.unit_finder_x.end(), begin_x, cmp_l);
-			i_end = std::lower_bound(funcs.st.unit_finder_x.begin(), funcs.st.unit_finder_x.end(), end_x, cmp_l);
+			i_begin = funcs.st.unit_finder_x.lower_bound(begin_x, cmp_l);
+			i_end = funcs.st.unit_finder_x.lower_bound(end_x, cmp_l);
 		}
 	public:
 		~unit_finder_search() {
-			--funcs.unit_finder_search_index;
-			for (auto i = i_begin; i != i_end; ++i) {
-				i->u->unit_finder_visited[search_index] = false;
-			}
+			--funcs.unit_finder_active_searches;
 		}
 
 		iterator begin() {
 			auto r = iterator(this, i_begin);
-			if (i_begin != i_end) {
-				if (r.in_bounds()) r->unit_finder_visited[search_index] = true;
-				else ++r;
-			}
+			if (i_begin != i_end && (!r.in_bounds() || !r.first_entry())) ++r;
 			return r;
 		}
 		iterator end() {
@@ -15793,12 +16534,13 @@ struct state_functions {
 
 	template<typename F>
 	unit_t* find_nearest_unit(xy pos, rect search_area, F&& predicate) const {
+		unit_finder_flush();
 
 		auto cmp_l = [&](auto& a, int b) {
 			return a.value < b;
 		};
-		auto x_i = std::lower_bound(st.unit_finder_x.begin(), st.unit_finder_x.end(), pos.x, cmp_l);
-		auto y_i = std::lower_bound(st.unit_finder_y.begin(), st.unit_finder_y.end(), pos.y, cmp_l);
+		auto x_i = st.unit_finder_x.lower_bound(pos.x, cmp_l);
+		auto y_i = st.unit_finder_y.lower_bound(pos.y, cmp_l);
 
 		return find_nearest_unit(pos, search_area, x_i, y_i, x_i, y_i, predicate);
 	}
@@ -15808,11 +16550,12 @@ struct state_functions {
 		if (us_hidden(u)) {
 			return find_nearest_unit(u->sprite->position, search_area, std::forward<F>(predicate));
 		} else {
+			unit_finder_flush();
 			auto cmp_l = [&](auto& a, int b) {
 				return a.value < b;
 			};
 			auto get = [&](auto& vec, int value) {
-				auto i = std::lower_bound(vec.begin(), vec.end(), value, cmp_l);
+				auto i = vec.lower_bound(value, cmp_l);
 				while (i->u != u) ++i;
 				return i;
 			};
@@ -15824,6 +16567,110 @@ struct state_functions {
 		}
 	}
 
+	// Queries for code that controls players, like bots. Each does a single
+	// unit finder search and writes the units to a static_vector supplied by
+	// the caller, which is cleared first, so they never allocate. Units that do
+	// not fit are dropped, and the return value is the number of units that
+	// matched, which is larger than r.size() if any were dropped; except for
+	// find_nearest_units, which keeps the nearest units and returns r.size().
+	// Distances are between sprite positions as measured by xy_length, unless
+	// stated otherwise, and units are in unit finder order.
+
+	template<size_t N, typename F>
+	size_t find_units_in_radius(xy pos, int radius, static_vector<unit_t*, N>& r, F&& predicate) const {
+		r.clear();
+		size_t n = 0;
+		for (unit_t* u : find_units({pos - xy(radius, radius), pos + xy(radius + 1, radius + 1)})) {
+			if (xy_length(u->sprite->position - pos) > radius) continue;
+			if (!predicate(u)) continue;
+			if (r.size() != N) r.push_back(u);
+			++n;
+		}
+		return n;
+	}
+
+	template<size_t N>
+	size_t find_units_in_radius(xy pos, int radius, static_vector<unit_t*, N>& r) const {
+		return find_units_in_radius(pos, radius, r, [](unit_t*) {
+			return true;
+		});
+	}
+
+	// The N nearest units within max_distance for which predicate is true,
+	// nearest first, with units at the same distance in unit finder order.
+	// predicate is not called for units farther away than the N nearest found
+	// so far.
+	template<size_t N, typename F>
+	size_t find_nearest_units(xy pos, int max_distance, static_vector<unit_t*, N>& r, F&& predicate) const {
+		static_assert(N > 0, "find_nearest_units: N must be at least 1");
+		r.clear();
+		std::array<int, N> distances;
+		for (unit_t* u : find_units({pos - xy(max_distance, max_distance), pos + xy(max_distance + 1, max_distance + 1)})) {
+			int d = xy_length(u->sprite->position - pos);
+			if (d > max_distance) continue;
+			if (r.size() == N && d >= distances[N - 1]) continue;
+			if (!predicate(u)) continue;
+			size_t i = r.size();
+			if (i == N) --i;
+			else r.push_back(u);
+			for (; i && distances[i - 1] > d; --i) {
+				r[i] = r[i - 1];
+				distances[i] = distances[i - 1];
+			}
+			r[i] = u;
+			distances[i] = d;
+		}
+		return r.size();
+	}
+
+	// Units whose unit finder bounding box intersects area (which includes
+	// area.to), that belong to a player in owner_mask (bit n for player n) and
+	// are of a type in types.
+	template<size_t N>
+	size_t find_units_in_rect(rect area, uint32_t owner_mask, const unit_type_mask& types, static_vector<unit_t*, N>& r) const {
+		r.clear();
+		size_t n = 0;
+		for (unit_t* u : find_units({area.from, area.to + xy(1, 1)})) {
+			if (~owner_mask & (1u << u->owner)) continue;
+			if (!types.test(u->unit_type->id)) continue;
+			if (!is_intersecting(u->unit_finder_bounding_box, area)) continue;
+			if (r.size() != N) r.push_back(u);
+			++n;
+		}
+		return n;
+	}
+
+	// Enemy units that u can attack with a weapon right now, without moving:
+	// the same distance (between bounding boxes) and minimum and maximum range
+	// checks as unit_can_fire_weapon, with the weapon unit_target_weapon picks.
+	template<size_t N>
+	size_t find_enemies_in_weapon_range(const unit_t* u, static_vector<unit_t*, N>& r) const {
+		r.clear();
+		int max_range = 0;
+		for (auto* w : {unit_or_subunit_ground_weapon(u), unit_or_subunit_air_weapon(u)}) {
+			if (w) max_range = std::max(max_range, weapon_max_range(u, w));
+		}
+		if (max_range == 0) return 0;
+		const unit_t* main_unit = unit_main_unit(u);
+		rect area = unit_sprite_bounding_box(main_unit);
+		area.from -= xy(max_range + 1, max_range + 1);
+		area.to += xy(max_range + 1, max_range + 1);
+		size_t n = 0;
+		for (unit_t* target : find_units(area)) {
+			if (target == main_unit) continue;
+			if (!unit_target_is_enemy(u, target)) continue;
+			if (!unit_can_attack_target(u, target)) continue;
+			auto* w = unit_target_weapon(u, target);
+			if (!w) continue;
+			int d = units_distance(main_unit, target);
+			if (w->min_range && d < w->min_range) continue;
+			if (d > weapon_max_range(u, w)) continue;
+			if (r.size() != N) r.push_back(target);
+			++n;
+		}
+		return n;
+	}
+
 	bool unit_is_factory(const unit_t* u) const {
 		if (unit_is(u, UnitTypes::Terran_Command_Center)) return true;
 		if (unit_is(u, UnitTypes::Terran_Barracks)) return true;
@@ -16284,6 +17131,7 @@ struct state_functions {
 		else u->order_type = get_order_type(Orders::Nothing);
 		set_secondary_order(u, get_order_type(Orders::Nothing));
 		u->unit_finder_bounding_box = { {-1, -1}, {-1, -1} };
+		unit_soa_update_bounding_box(u);
 		st.player_units[owner].push_front(*u);
 		increment_unit_counts(u, 1);
 
@@ -18860,9 +19708,9 @@ struct state_functions {
 			if (u->unit_type->group_flags & GroupFlags::Men) ++r.completed_non_building_counts[u->owner];
 			else if (u->unit_type->group_flags & GroupFlags::Building) ++r.completed_building_counts[u->owner];
 		};
-		for (const unit_t* u : find_units(loc.area)) {
-			if (ut_turret(u)) continue;
-			if (!unit_is_at_elevation_flags(u, loc.elevation_flags)) continue;
+		auto add = [&](const unit_t* u) {
+			if (ut_turret(u)) return;
+			if (!unit_is_at_elevation_flags(u, loc.elevation_flags)) return;
 
 			++r.unit_counts[u->owner][u->unit_type->id];
 			if (u->unit_type->group_flags & GroupFlags::Factory) ++r.factory_counts[u->owner];
@@ -18871,7 +19719,15 @@ struct state_functions {
 			else if (unit_is_egg(u)) ++r.non_building_counts[u->owner];
 
 			if (u_completed(u)) add_completed(u);
-
+		};
+		// Only counts are collected, so the order the units are found in does
+		// not matter.
+		if (st.unit_soa.enabled) {
+			unit_soa_find_units(loc.area, [&](size_t index) {
+				add(st.units_container.at(index));
+			});
+		} else {
+			for (const unit_t* u : find_units(loc.area)) add(u);
 		}
 		return r;
 	}
@@ -19386,6 +20242,10 @@ struct state_functions {
 
 	void set_tile_creep(xy_t<size_t> tile_pos, bool has_creep = true) {
 		size_t index = tile_pos.y * game_st.map_tile_width + tile_pos.x;
+		if (creep_frontier) {
+			if (!has_creep) error("set_tile_creep: creep can not be removed while creep_frontier is set");
+			if (~st.tiles[index].flags & tile_t::flag_has_creep) creep_frontier_add_creep(*creep_frontier, tile_pos);
+		}
 		if (has_creep) st.tiles[index].flags |= tile_t::flag_has_creep;
 		else st.tiles[index].flags &= ~tile_t::flag_has_creep;
 
@@ -19477,6 +20337,77 @@ struct state_functions {
 		return false;
 	}
 
+	void creep_frontier_init(creep_frontier_t& f, unit_type_autocast unit_type, xy pos) {
+		bool spreads_creep = unit_type_spreads_creep(unit_type, true);
+		f.area = get_max_creep_bb(unit_type, pos, true);
+		size_t area_width = f.area.to.x - f.area.from.x + 1;
+		size_t area_height = f.area.to.y - f.area.from.y + 1;
+		f.candidate.assign(area_width * area_height, 0);
+		f.n_neighboring_creep_tiles.assign(area_width * area_height, 0);
+		for (auto& v : f.target_tiles) v.clear();
+		int dy = (int)f.area.from.y * 32 - pos.y + 16;
+		size_t i = 0;
+		for (size_t tile_y = f.area.from.y; tile_y != f.area.to.y + 1; ++tile_y, dy += 32) {
+			int dx = (int)f.area.from.x * 32 - pos.x + 16;
+			for (size_t tile_x = f.area.from.x; tile_x != f.area.to.x + 1; ++tile_x, dx += 32, ++i) {
+				size_t index = tile_y * game_st.map_tile_width + tile_x;
+				auto flags = st.tiles[index].flags;
+				if (flags & (tile_t::flag_has_creep | tile_t::flag_occupied)) continue;
+				if (!tile_can_have_creep({tile_x, tile_y})) continue;
+				if (spreads_creep) {
+					int d = dx*dx * 25 + dy*dy * 64;
+					if (d > 320*320 * 25) continue;
+				}
+				f.candidate[i] = 1;
+				size_t n = count_neighboring_creep_tiles({tile_x, tile_y});
+				f.n_neighboring_creep_tiles[i] = (uint8_t)n;
+				if (n) f.target_tiles[n - 1].push_back(index);
+			}
+		}
+	}
+
+	// Called by set_tile_creep before tile_pos gets creep.
+	void creep_frontier_add_creep(creep_frontier_t& f, xy_t<size_t> tile_pos) {
+		size_t area_width = f.area.to.x - f.area.from.x + 1;
+		auto remove = [&](size_t n, size_t index) {
+			auto& v = f.target_tiles[n - 1];
+			v.erase(std::lower_bound(v.begin(), v.end(), index));
+		};
+		auto insert = [&](size_t n, size_t index) {
+			auto& v = f.target_tiles[n - 1];
+			v.insert(std::lower_bound(v.begin(), v.end(), index), index);
+		};
+		for (size_t y = tile_pos.y - 1; y != tile_pos.y + 2; ++y) {
+			if (y < f.area.from.y || y > f.area.to.y) continue;
+			for (size_t x = tile_pos.x - 1; x != tile_pos.x + 2; ++x) {
+				if (x < f.area.from.x || x > f.area.to.x) continue;
+				size_t i = (y - f.area.from.y) * area_width + (x - f.area.from.x);
+				if (!f.candidate[i]) continue;
+				size_t index = y * game_st.map_tile_width + x;
+				size_t n = f.n_neighboring_creep_tiles[i];
+				if (n) remove(n, index);
+				if (x == tile_pos.x && y == tile_pos.y) {
+					f.candidate[i] = 0;
+					continue;
+				}
+				++n;
+				insert(n, index);
+				f.n_neighboring_creep_tiles[i] = (uint8_t)n;
+			}
+		}
+	}
+
+	// Does the same as spread_creep with the tiles of f.
+	bool creep_frontier_spread(creep_frontier_t& f) {
+		for (auto& v : reverse(f.target_tiles)) {
+			if (v.empty()) continue;
+			size_t index = v[(lcg_rand(26) >> 4) % v.size()];
+			set_tile_creep({index % game_st.map_tile_width, index / game_st.map_tile_width});
+			return true;
+		}
+		return false;
+	}
+
 	void spread_creep_completely(unit_type_autocast unit_type, xy pos) {
 		rect_t<xy_t<size_t>> unit_area;
 		unit_area.from.x = pos.x / 32u - unit_type->placement_size.x / 32u / 2;
@@ -19491,7 +20422,10 @@ struct state_functions {
 				set_tile_creep({x, y});
 			}
 		}
-		while (spread_creep(unit_type, pos));
+		creep_frontier_t frontier;
+		creep_frontier_init(frontier, unit_type, pos);
+		auto cfs = make_thingy_setter(creep_frontier, &frontier);
+		while (creep_frontier_spread(frontier));
 	}
 
 	xy get_spawn_larva_position(unit_t* u) {
@@ -19760,6 +20694,176 @@ static inline state copy_state(const state& st) {
 	return r;
 }
 
+// A snapshot of a state that can be restored into the state it was taken
+// from (and only that state). Objects are saved and restored in place byte for
+// byte, so unlike copy_state nothing has to be remapped or allocated.
+// When a previous snapshot of the same state is passed as base, the object
+// blocks (one object_container chunk each) that did not change since then are
+// shared with it instead of being copied. Everything else is copied in full by
+// every snapshot: state_base_copyable (including the tiles, creep_life and the
+// optional unit_soa, vision_bitboards and incremental_vision mirrors), the
+// unit finder lists, and every path and thingy. Finding the unchanged blocks
+// is a memcmp of every block against base. Taking a snapshot therefore takes
+// time proportional to the map size and the number of allocated objects, and
+// only the memory used for objects is limited to the changed blocks.
+// Restoring never frees anything, which keeps every snapshot of a state valid
+// until the state itself is destroyed or assigned to.
+struct state_snapshot {
+	using block = std::shared_ptr<const a_vector<uint8_t>>;
+
+	const state* source = nullptr;
+	state_base_copyable copyable;
+	a_vector<uint8_t> headers;
+	std::array<a_vector<const void*>, 5> block_addresses;
+	std::array<a_vector<block>, 5> blocks;
+	state_base_non_copyable::unit_finder_list unit_finder_x;
+	state_base_non_copyable::unit_finder_list unit_finder_y;
+	a_vector<const path_t*> path_addresses;
+	a_vector<path_t> paths;
+	a_vector<const thingy_t*> thingy_addresses;
+	a_vector<thingy_t> thingies;
+
+	size_t copied_blocks = 0;
+	size_t shared_blocks = 0;
+
+	template<typename state_T, typename F>
+	static void for_each_container(state_T& st, F&& f) {
+		f(st.units_container, 0);
+		f(st.bullets_container, 1);
+		f(st.sprites_container, 2);
+		f(st.images_container, 3);
+		f(st.orders_container, 4);
+	}
+
+	// Everything in state_base_non_copyable that is not an object, a path,
+	// a thingy or a unit finder entry.
+	template<typename state_T, typename F>
+	static void for_each_header(state_T& st, F&& f) {
+		auto h = [&](auto& v) {
+			f((void*)&v, sizeof(v));
+		};
+		h(st.visible_units);
+		h(st.hidden_units);
+		h(st.map_revealer_units);
+		h(st.dead_units);
+		for (auto& v : st.player_units) h(v);
+		h(st.cloaked_units);
+		h(st.psionic_matrix_units);
+		h(st.active_bullets);
+		for_each_container(st, [&](auto& c, size_t) {
+			h(c.free_list);
+			h(c.size);
+		});
+		h(st.free_paths);
+		h(st.active_thingies);
+		h(st.free_thingies);
+		h(st.consider_collision_with_unit_bug);
+		h(st.prev_bullet_source_unit);
+		if (!st.sprites_on_tile_line.empty()) {
+			f((void*)st.sprites_on_tile_line.data(), st.sprites_on_tile_line.size() * sizeof(st.sprites_on_tile_line[0]));
+		}
+	}
+
+	void take(const state& st, const state_snapshot* base = nullptr) {
+		if (base && base->source != &st) base = nullptr;
+		source = &st;
+		copied_blocks = 0;
+		shared_blocks = 0;
+
+		copyable = (const state_base_copyable&)st;
+
+		headers.clear();
+		for_each_header(st, [&](const void* data, size_t size) {
+			headers.insert(headers.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+		});
+
+		for_each_container(st, [&](auto& c, size_t index) {
+			auto& addresses = block_addresses[index];
+			auto& dst = blocks[index];
+			addresses.clear();
+			dst.clear();
+			size_t chunks = c.size ? (c.size - 1) / c.list.front().size() + 1 : 0;
+			for (size_t i = 0; i != chunks; ++i) {
+				const uint8_t* data = (const uint8_t*)c.list[i].data();
+				size_t size = sizeof(c.list[i]);
+				addresses.push_back(data);
+				if (base && i < base->blocks[index].size() && base->block_addresses[index][i] == data && memcmp(base->blocks[index][i]->data(), data, size) == 0) {
+					dst.push_back(base->blocks[index][i]);
+					++shared_blocks;
+				} else {
+					dst.push_back(std::make_shared<a_vector<uint8_t>>(data, data + size));
+					++copied_blocks;
+				}
+			}
+		});
+
+		unit_finder_x = st.unit_finder_x;
+		unit_finder_y = st.unit_finder_y;
+
+		path_addresses.clear();
+		paths.clear();
+		for (auto& v : st.paths) {
+			path_addresses.push_back(&v);
+			paths.push_back(v);
+		}
+		thingy_addresses.clear();
+		thingies.clear();
+		for (auto& v : st.thingies) {
+			thingy_addresses.push_back(&v);
+			thingies.push_back(v);
+		}
+	}
+
+	template<typename T>
+	static void restore_list(a_list<T>& list, a_list<T>& unused, const a_vector<const T*>& addresses, const a_vector<T>& values) {
+		size_t n = addresses.size();
+		if (list.size() > n) {
+			unused.splice(unused.begin(), list, std::next(list.begin(), n), list.end());
+		} else if (list.size() < n) {
+			if (unused.size() < n - list.size()) error("state_snapshot::restore: state does not match snapshot");
+			list.splice(list.end(), unused, unused.begin(), std::next(unused.begin(), n - list.size()));
+		}
+		size_t i = 0;
+		for (auto& v : list) {
+			if (&v != addresses[i]) error("state_snapshot::restore: state does not match snapshot");
+			v = values[i];
+			++i;
+		}
+	}
+
+	void restore(state& st) const {
+		if (source != &st) error("state_snapshot::restore: snapshot was not taken from this state");
+
+		for_each_container(st, [&](auto& c, size_t index) {
+			auto& addresses = block_addresses[index];
+			if (c.list.size() < addresses.size()) error("state_snapshot::restore: state does not match snapshot");
+			for (size_t i = 0; i != addresses.size(); ++i) {
+				if ((const void*)c.list[i].data() != addresses[i]) error("state_snapshot::restore: state does not match snapshot");
+				memcpy((void*)c.list[i].data(), blocks[index][i]->data(), blocks[index][i]->size());
+			}
+		});
+
+		size_t headers_size = 0;
+		for_each_header(st, [&](void*, size_t size) {
+			headers_size += size;
+		});
+		if (headers_size != headers.size()) error("state_snapshot::restore: state does not match snapshot");
+		const uint8_t* p = headers.data();
+		for_each_header(st, [&](void* data, size_t size) {
+			memcpy(data, p, size);
+			p += size;
+		});
+
+		(state_base_copyable&)st = copyable;
+
+		st.unit_finder_x = unit_finder_x;
+		st.unit_finder_y = unit_finder_y;
+
+		restore_list(st.paths, st.unused_paths, path_addresses, paths);
+		restore_list(st.thingies, st.unused_thingies, thingy_addresses, thingies);
+	}
+};
+
 
 struct game_load_functions : state_functions {
 
@@ -19799,7 +20903,9 @@ struct game_load_functions : state_functions {
 		return &global_st.flingy_types.vec[(size_t)id];
 	}
 
-	void reset() {
+	// Loads everything in game_st that does not come directly from map chunks.
+	// Only called when game_st is not already loaded; see load_map_data.
+	void reset_game_state() {
 
 		game_st.unit_types = data_loading::load_units_dat(global_st.units_dat);
 		game_st.weapon_types = data_loading::load_weapons_dat(global_st.weapons_dat);
@@ -19875,6 +20981,46 @@ struct game_load_functions : state_functions {
 			}
 		}
 
+		auto set_acquisition_ranges = [&]() {
+			for (size_t i = 0; i != 228; ++i) {
+				unit_type_t* unit_type = get_unit_type((UnitTypes)i);
+				const unit_type_t* attacking_type = unit_type;
+				if (unit_type->turret_unit_type) attacking_type = unit_type->turret_unit_type;
+				const weapon_type_t* ground_weapon = attacking_type->ground_weapon;
+				const weapon_type_t* air_weapon = attacking_type->air_weapon;
+				int acq_range = attacking_type->target_acquisition_range;
+				if (ground_weapon) acq_range = std::max(acq_range, ground_weapon->max_range / 32);
+				if (air_weapon) acq_range = std::max(acq_range, air_weapon->max_range / 32);
+				unit_type->target_acquisition_range = acq_range;
+			}
+		};
+		set_acquisition_ranges();
+
+		calculate_unit_strengths();
+
+		generate_sight_values();
+
+		load_tile_stuff();
+
+		int max_unit_width = 0;
+		int max_unit_height = 0;
+		for (auto& v : game_st.unit_types.vec) {
+			int width = v.dimensions.from.x + 1 + v.dimensions.to.x;
+			int height = v.dimensions.from.y + 1 + v.dimensions.to.y;
+			if (width > max_unit_width) max_unit_width = width;
+			if (height > max_unit_height) max_unit_height = height;
+		}
+		game_st.max_unit_width = max_unit_width;
+		game_st.max_unit_height = max_unit_height;
+
+		game_st.repulse_field_width = (game_st.map_width + 47) / 48;
+		game_st.repulse_field_height = (game_st.map_height + 47) / 48;
+
+		game_st.triggers.clear();
+	}
+
+	void reset() {
+
 		st.alliances = {};
 		for (size_t i = 0; i != 12; ++i) {
 			st.alliances[i] = {};
@@ -19910,27 +21056,6 @@ struct game_load_functions : state_functions {
 		st.supply_used = {};
 		st.supply_available = {};
 
-		auto set_acquisition_ranges = [&]() {
-			for (size_t i = 0; i != 228; ++i) {
-				unit_type_t* unit_type = get_unit_type((UnitTypes)i);
-				const unit_type_t* attacking_type = unit_type;
-				if (unit_type->turret_unit_type) attacking_type = unit_type->turret_unit_type;
-				const weapon_type_t* ground_weapon = attacking_type->ground_weapon;
-				const weapon_type_t* air_weapon = attacking_type->air_weapon;
-				int acq_range = attacking_type->target_acquisition_range;
-				if (ground_weapon) acq_range = std::max(acq_range, ground_weapon->max_range / 32);
-				if (air_weapon) acq_range = std::max(acq_range, air_weapon->max_range / 32);
-				unit_type->target_acquisition_range = acq_range;
-			}
-		};
-		set_acquisition_ranges();
-
-		calculate_unit_strengths();
-
-		generate_sight_values();
-
-		load_tile_stuff();
-
 		st.tiles.clear();
 		st.tiles.resize(game_st.map_tile_width*game_st.map_tile_height);
 		for (auto& v : st.tiles) {
@@ -19939,6 +21064,9 @@ struct game_load_functions : state_functions {
 		}
 		st.tiles_mega_tile_index.clear();
 		st.tiles_mega_tile_index.resize(st.tiles.size());
+		vision_bitboards_rebuild();
+		incremental_vision_reset();
+		unit_soa_reset();
 
 		st.update_tiles_countdown = 1;
 
@@ -19971,6 +21099,7 @@ struct game_load_functions : state_functions {
 		st.active_thingies.clear();
 		st.free_thingies.clear();
 		st.thingies.clear();
+		st.unused_thingies.clear();
 
 		auto* cursor = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Cursor_Marker), {}, 0);
 		if (cursor) {
@@ -19985,27 +21114,12 @@ struct game_load_functions : state_functions {
 		st.trigger_wait_timers = {};
 		st.trigger_waiting = {};
 
-		int max_unit_width = 0;
-		int max_unit_height = 0;
-		for (auto& v : game_st.unit_types.vec) {
-			int width = v.dimensions.from.x + 1 + v.dimensions.to.x;
-			int height = v.dimensions.from.y + 1 + v.dimensions.to.y;
-			if (width > max_unit_width) max_unit_width = width;
-			if (height > max_unit_height) max_unit_height = height;
-		}
-		game_st.max_unit_width = max_unit_width;
-		game_st.max_unit_height = max_unit_height;
-
 		st.random_counts = {};
 		st.total_random_counts = 0;
 		st.lcg_rand_state = 42;
 
-		game_st.repulse_field_width = (game_st.map_width + 47) / 48;
-		game_st.repulse_field_height = (game_st.map_height + 47) / 48;
 		st.repulse_field.resize(game_st.repulse_field_width * game_st.repulse_field_height);
 
-		game_st.triggers.clear();
-
 		st.prev_bullet_source_unit = nullptr;
 		st.consider_collision_with_unit_bug = nullptr;
 
@@ -20036,9 +21150,6 @@ struct game_load_functions : state_functions {
 
 		a_vector<uint8_t> unwalkable_flags(256 * 4 * 256 * 4);
 
-		auto is_unwalkable = [&](size_t walk_x, size_t walk_y) {
-			return unwalkable_flags[walk_y * 256 * 4 + walk_x] & 0x80 ? true : false;
-		};
 		auto is_walkable = [&](size_t walk_x, size_t walk_y) {
 			return ~unwalkable_flags[walk_y * 256 * 4 + walk_x] & 0x80 ? true : false;
 		};
@@ -20051,9 +21162,6 @@ struct game_load_functions : state_functions {
 		auto is_dir_unwalkable = [&](size_t walk_x, size_t walk_y, size_t dir) {
 			return unwalkable_flags[walk_y * 256 * 4 + walk_x] & (1 << dir) ? true : false;
 		};
-		auto set_dir_unwalkable = [&](size_t walk_x, size_t walk_y, size_t dir) {
-			unwalkable_flags[walk_y * 256 * 4 + walk_x] |= 1 << dir;
-		};
 		auto flip_dir_walkable = [&](size_t walk_x, size_t walk_y, size_t dir) {
 			unwalkable_flags[walk_y * 256 * 4 + walk_x] ^= 1 << dir;
 		};
@@ -20063,17 +21171,20 @@ struct game_load_functions : state_functions {
 
 		auto set_unwalkable_flags = [&]() {
 
+			// The flags of the 4x4 walk tiles of each mega tile, which are copied
+			// a row at a time.
+			a_vector<std::array<uint8_t, 16>> mega_tile_flags(game_st.vf4.size());
+			for (size_t i = 0; i != game_st.vf4.size(); ++i) {
+				for (size_t n = 0; n != 16; ++n) {
+					mega_tile_flags[i][n] = game_st.vf4[i].flags[n] & vf4_entry::flag_walkable ? 0 : 0x80;
+				}
+			}
 			for (size_t y = 0; y != game_st.map_tile_height; ++y) {
 				for (size_t x = 0; x != game_st.map_tile_width; ++x) {
 					uint16_t mega_tile_index = st.tiles_mega_tile_index[y * game_st.map_tile_width + x];
-
-					auto& mt = game_st.vf4[mega_tile_index & 0x7fff];
+					auto& mt = mega_tile_flags.at(mega_tile_index & 0x7fff);
 					for (size_t sy = 0; sy < 4; ++sy) {
-						for (size_t sx = 0; sx < 4; ++sx) {
-							if (~mt.flags[sy * 4 + sx] & vf4_entry::flag_walkable) {
-								set_unwalkable(x * 4 + sx, y * 4 + sy);
-							}
-						}
+						memcpy(&unwalkable_flags[(y * 4 + sy) * 256 * 4 + x * 4], &mt[sy * 4], 4);
 					}
 				}
 			}
@@ -20098,13 +21209,24 @@ struct game_load_functions : state_functions {
 
 			if (game_st.map_walk_width == 0 || game_st.map_walk_height == 0) error("map width/height is zero");
 
+			// Set the direction bits of every walkable walk tile whose neighbor in
+			// that direction is unwalkable or outside the map. This is done a row
+			// at a time without branches; the current row is copied with an
+			// unwalkable walk tile on either side, and rows outside the map are
+			// entirely unwalkable.
+			size_t width = game_st.map_walk_width;
+			a_vector<uint8_t> outside(width, 0x80);
+			a_vector<uint8_t> row(width + 2, 0x80);
 			for (size_t y = 0; y != game_st.map_walk_height; ++y) {
-				for (size_t x = 0; x != game_st.map_walk_width; ++x) {
-					if (is_unwalkable(x, y)) continue;
-					if (y == 0 || is_unwalkable(x, y - 1)) set_dir_unwalkable(x, y, 0);
-					if (x == game_st.map_walk_width - 1 || is_unwalkable(x + 1, y)) set_dir_unwalkable(x, y, 1);
-					if (y == game_st.map_walk_height - 1 || is_unwalkable(x, y + 1)) set_dir_unwalkable(x, y, 2);
-					if (x == 0 || is_unwalkable(x - 1, y)) set_dir_unwalkable(x, y, 3);
+				uint8_t* cur = &unwalkable_flags[y * 256 * 4];
+				const uint8_t* above = y == 0 ? outside.data() : cur - 256 * 4;
+				const uint8_t* below = y == game_st.map_walk_height - 1 ? outside.data() : cur + 256 * 4;
+				memcpy(row.data() + 1, cur, width);
+				const uint8_t* r = row.data();
+				for (size_t x = 0; x != width; ++x) {
+					uint8_t v = r[x + 1];
+					uint8_t dirs = (uint8_t)((above[x] >> 7) | (r[x + 2] >> 7 << 1) | (below[x] >> 7 << 2) | (r[x] >> 7 << 3));
+					cur[x] = v | (dirs & (uint8_t)((v >> 7) - 1));
 				}
 			}
 		};
@@ -20684,7 +21806,12 @@ struct game_load_functions : state_functions {
 				x = x / 4 * 4;
 				size_t start_x = x;
 				size_t start_y = y;
-				while (is_every_dir_walkable(x, y) && is_every_dir_walkable(x + 1, y) && is_every_dir_walkable(x + 2, y) && is_every_dir_walkable(x + 3, y)) {
+				auto is_every_dir_walkable_4 = [&](size_t walk_x, size_t walk_y) {
+					uint32_t v;
+					memcpy(&v, &unwalkable_flags[walk_y * 256 * 4 + walk_x], 4);
+					return (v & 0x7f7f7f7f) == 0;
+				};
+				while (is_every_dir_walkable_4(x, y)) {
 					x += 4;
 					if (x == game_st.map_walk_width) {
 						x = 0;
@@ -20825,6 +21952,178 @@ struct game_load_functions : state_functions {
 
 	}
 
+	// A hash of everything regions_create reads.
+	uint64_t regions_cache_key() const {
+		uint64_t r = 0xcbf29ce484222325;
+		auto add = [&](const void* data, size_t size) {
+			for (size_t i = 0; i != size; ++i) {
+				r ^= ((const uint8_t*)data)[i];
+				r *= 0x100000001b3;
+			}
+		};
+		uint32_t version = 2;
+		add(&version, 4);
+		uint32_t width = (uint32_t)game_st.map_tile_width;
+		uint32_t height = (uint32_t)game_st.map_tile_height;
+		add(&width, 4);
+		add(&height, 4);
+		for (size_t i = 0; i != game_st.map_tile_width * game_st.map_tile_height; ++i) {
+			add(&st.tiles[i].flags, 2);
+			add(&st.tiles_mega_tile_index[i], 2);
+		}
+		for (auto& v : game_st.vf4) add(v.flags.data(), sizeof(v.flags));
+		return r;
+	}
+
+	// The data starts with key and ends with a hash of everything before it,
+	// so that load_regions can reject entries that were stored under the wrong
+	// key or were damaged.
+	a_vector<uint8_t> save_regions(uint64_t key) const {
+		auto& regions = game_st.regions;
+		a_vector<uint8_t> r;
+		auto put = [&](uint32_t v) {
+			for (size_t i = 0; i != 4; ++i) r.push_back((uint8_t)(v >> (8 * i)));
+		};
+		put((uint32_t)key);
+		put((uint32_t)(key >> 32));
+		auto put_index = [&](const regions_t::region* v) {
+			put(v ? (uint32_t)v->index : ~(uint32_t)0);
+		};
+		put(regions.regions.size());
+		for (auto& v : regions.regions) {
+			put(v.flags);
+			put(v.tile_center.x);
+			put(v.tile_center.y);
+			put(v.tile_area.from.x);
+			put(v.tile_area.from.y);
+			put(v.tile_area.to.x);
+			put(v.tile_area.to.y);
+			put(v.center.x.raw_value);
+			put(v.center.y.raw_value);
+			put(v.area.from.x);
+			put(v.area.from.y);
+			put(v.area.to.x);
+			put(v.area.to.y);
+			put(v.tile_count);
+			put(v.group_index);
+			put(v.walkable_neighbors.size());
+			for (auto* n : v.walkable_neighbors) put_index(n);
+			put(v.non_walkable_neighbors.size());
+			for (auto* n : v.non_walkable_neighbors) put_index(n);
+		}
+		put(regions.split_regions.size());
+		for (auto& v : regions.split_regions) {
+			put(v.mask);
+			put_index(v.a);
+			put_index(v.b);
+		}
+		for (auto& c : regions.contours) {
+			put(c.size());
+			for (auto& v : c) {
+				for (int x : v.v) put(x);
+				put(v.dir);
+				put(v.flags);
+			}
+		}
+		put(regions.tile_bounding_box.from.x);
+		put(regions.tile_bounding_box.from.y);
+		put(regions.tile_bounding_box.to.x);
+		put(regions.tile_bounding_box.to.y);
+		for (size_t v : regions.tile_region_index) put(v);
+		uint64_t checksum = map_data_hash(r.data(), r.size());
+		put((uint32_t)checksum);
+		put((uint32_t)(checksum >> 32));
+		return r;
+	}
+
+	void load_regions(const uint8_t* data, size_t data_size, uint64_t key) {
+		auto& regions = game_st.regions;
+		if (data_size < 16) error("load_regions: data too short");
+		data_loading::data_reader_le r(data, data + data_size - 8);
+		auto get = [&]() {
+			return r.get<uint32_t>();
+		};
+		data_loading::data_reader_le checksum_r(data + data_size - 8, data + data_size);
+		if (checksum_r.get<uint64_t>() != map_data_hash(data, data_size - 8)) error("load_regions: checksum mismatch");
+		if (r.get<uint64_t>() != key) error("load_regions: key mismatch");
+		auto get_index = [&]() -> regions_t::region* {
+			uint32_t v = get();
+			if (v == ~(uint32_t)0) return nullptr;
+			if (v >= regions.regions.size()) error("load_regions: invalid region index %d", v);
+			return &regions.regions[v];
+		};
+		regions.regions.clear();
+		regions.regions.resize(get());
+		for (size_t i = 0; i != regions.regions.size(); ++i) {
+			auto& v = regions.regions[i];
+			v.index = i;
+			v.flags = (uint16_t)get();
+			v.tile_center.x = get();
+			v.tile_center.y = get();
+			v.tile_area.from.x = get();
+			v.tile_area.from.y = get();
+			v.tile_area.to.x = get();
+			v.tile_area.to.y = get();
+			v.center.x = fp8::from_raw((int32_t)get());
+			v.center.y = fp8::from_raw((int32_t)get());
+			v.area.from.x = (int32_t)get();
+			v.area.from.y = (int32_t)get();
+			v.area.to.x = (int32_t)get();
+			v.area.to.y = (int32_t)get();
+			v.tile_count = get();
+			v.group_index = get();
+			v.walkable_neighbors.resize(get());
+			for (auto& n : v.walkable_neighbors) n = get_index();
+			v.non_walkable_neighbors.resize(get());
+			for (auto& n : v.non_walkable_neighbors) n = get_index();
+		}
+		regions.split_regions.resize(get());
+		for (auto& v : regions.split_regions) {
+			v.mask = (uint16_t)get();
+			v.a = get_index();
+			v.b = get_index();
+		}
+		for (auto& c : regions.contours) {
+			c.resize(get());
+			for (auto& v : c) {
+				for (int& x : v.v) x = (int32_t)get();
+				v.dir = get();
+				v.flags = (uint8_t)get();
+			}
+		}
+		regions.tile_bounding_box.from.x = get();
+		regions.tile_bounding_box.from.y = get();
+		regions.tile_bounding_box.to.x = get();
+		regions.tile_bounding_box.to.y = get();
+		for (size_t& v : regions.tile_region_index) {
+			v = get();
+			if (v < 0x2000 ? v < 5000 && v >= regions.regions.size() : v - 0x2000 >= regions.split_regions.size()) {
+				error("load_regions: invalid tile region index %d", v);
+			}
+		}
+		if (r.left()) error("load_regions: unexpected data at end");
+	}
+
+	// regions_create, using game_st.regions_cache if it is set.
+	void regions_create_cached() {
+		if (!game_st.regions_cache) {
+			regions_create();
+			return;
+		}
+		uint64_t key = regions_cache_key();
+		a_vector<uint8_t> data;
+		if (game_st.regions_cache->get(key, data)) {
+			try {
+				load_regions(data.data(), data.size(), key);
+				return;
+			} catch (const exception&) {
+				game_st.regions = regions_t();
+			}
+		}
+		regions_create();
+		game_st.regions_cache->put(key, save_regions(key));
+	}
+
 	int get_unit_strength(const unit_type_t* unit_type, const weapon_type_t* weapon_type) {
 		switch (unit_type->id) {
 		case UnitTypes::Terran_Vulture_Spider_Mine:
@@ -21227,10 +22526,25 @@ struct game_load_functions : state_functions {
 		load_map_data(data.data(), data.size(), std::move(setup_f), initial_processing);
 	}
 
+	static uint64_t map_data_hash(const uint8_t* data, size_t data_size) {
+		uint64_t r = 0xcbf29ce484222325;
+		for (size_t i = 0; i != data_size; ++i) {
+			r ^= data[i];
+			r *= 0x100000001b3;
+		}
+		return r;
+	}
+
+	// If game_st has already been loaded (see game_state::loaded) from the same
+	// map data, it is reused as is and only st is set up.
 	void load_map_data(uint8_t* data, size_t data_size, std::function<void()> setup_f = {}, bool initial_processing = true) {
 
 		using data_loading::data_reader_le;
 
+		uint64_t hash = map_data_hash(data, data_size);
+		if (game_st.loaded && game_st.map_data_hash != hash) error("load_map_data: game_state is already loaded with a different map");
+		bool load_game_state = !game_st.loaded;
+
 		a_unordered_map<tag_t, std::function<void(data_reader_le)>, tag_t> tag_funcs;
 
 		auto tagstr = [&](tag_t tag) {
@@ -21268,6 +22582,7 @@ struct game_load_functions : state_functions {
 			version = r.get<uint16_t>();
 		};
 		tag_funcs["DIM "] = [&](data_reader_le r) {
+			if (!load_game_state) return;
 			game_st.map_tile_width = r.get<uint16_t>();
 			game_st.map_tile_height = r.get<uint16_t>();
 			game_st.map_width = game_st.map_tile_width * 32;
@@ -21276,6 +22591,7 @@ struct game_load_functions : state_functions {
 			game_st.map_walk_height = game_st.map_tile_height * 4;
 		};
 		tag_funcs["ERA "] = [&](data_reader_le r) {
+			if (!load_game_state) return;
 			game_st.tileset_index = r.get<uint16_t>() % 8;
 		};
 		tag_funcs["OWNR"] = [&](data_reader_le r) {
@@ -21289,6 +22605,7 @@ struct game_load_functions : state_functions {
 			}
 		};
 		tag_funcs["STR "] = [&](data_reader_le r) {
+			if (!load_game_state) return;
 			if (r.left() < 2) return;
 			auto start = r;
 			size_t num = r.get<uint16_t>();
@@ -21308,19 +22625,23 @@ struct game_load_functions : state_functions {
 			}
 		};
 		tag_funcs["SPRP"] = [&](data_reader_le r) {
+			if (!load_game_state) return;
 			game_st.scenario_name = get_map_string(r.get<uint16_t>());
 			game_st.scenario_description = get_map_string(r.get<uint16_t>());
 		};
 		tag_funcs["FORC"] = [&](data_reader_le r) {
 			for (size_t i = 0; i != 12; ++i) st.players[i].force = 0;
-			for (size_t i = 0; i != 4; ++i) {
-				game_st.forces[i].name = "";
-				game_st.forces[i].flags = 0;
+			if (load_game_state) {
+				for (size_t i = 0; i != 4; ++i) {
+					game_st.forces[i].name = "";
+					game_st.forces[i].flags = 0;
+				}
 			}
 			if (r.left()) {
 				for (size_t i = 0; i != 8; ++i) {
 					st.players[i].force = r.get<uint8_t>();
 				}
+				if (!load_game_state) return;
 				for (size_t i = 0; i != 4; ++i) {
 					game_st.forces[i].name = get_map_string(r.get<uint16_t>());
 				}
@@ -21336,15 +22657,17 @@ struct game_load_functions : state_functions {
 
 
 		tag_funcs["MTXM"] = [&](data_reader_le r) {
-			game_st.gfx_tiles.resize(game_st.map_tile_width * game_st.map_tile_height);
-			for (size_t i = 0; r.left(); ++i) {
-				if (r.left() == 1) {
-					game_st.gfx_tiles.at(i).raw_value &= 0xff00;
-					game_st.gfx_tiles.at(i).raw_value |= r.get<uint8_t>();
-					break;
+			if (load_game_state) {
+				game_st.gfx_tiles.resize(game_st.map_tile_width * game_st.map_tile_height);
+				for (size_t i = 0; r.left(); ++i) {
+					if (r.left() == 1) {
+						game_st.gfx_tiles.at(i).raw_value &= 0xff00;
+						game_st.gfx_tiles.at(i).raw_value |= r.get<uint8_t>();
+						break;
+					}
+					if (i >= game_st.gfx_tiles.size()) break;
+					game_st.gfx_tiles.at(i) = tile_id(r.get<uint16_t>());
 				}
-				if (i >= game_st.gfx_tiles.size()) break;
-				game_st.gfx_tiles.at(i) = tile_id(r.get<uint16_t>());
 			}
 			for (size_t i = 0; i != game_st.gfx_tiles.size(); ++i) {
 				tile_id tile_id = game_st.gfx_tiles[i];
@@ -21367,7 +22690,7 @@ struct game_load_functions : state_functions {
 			tiles_flags_and(0, game_st.map_tile_height - 1, game_st.map_tile_width, 1, ~(tile_t::flag_walkable | tile_t::flag_has_creep | tile_t::flag_partially_walkable));
 			tiles_flags_or(0, game_st.map_tile_height - 1, game_st.map_tile_width, 1, tile_t::flag_unbuildable);
 
-			regions_create();
+			if (load_game_state) regions_create_cached();
 		};
 
 		bool use_map_settings = false;
@@ -21404,9 +22727,12 @@ struct game_load_functions : state_functions {
 				st.tiles[i].visible = mask[i];
 				st.tiles[i].explored = mask[i];
 			}
+			vision_bitboards_rebuild();
+			incremental_vision_reset();
 		};
 
 		auto units = [&](data_reader_le r, bool broodwar) {
+			if (!load_game_state) return;
 			auto uses_default_settings = r.get_vec<uint8_t>(228);
 			auto hp = r.get_vec<uint32_t>(228);
 			auto shield_points = r.get_vec<uint16_t>(228);
@@ -21442,6 +22768,7 @@ struct game_load_functions : state_functions {
 		};
 
 		auto upgrades = [&](data_reader_le r, bool broodwar) {
+			if (!load_game_state) return;
 			auto uses_default_settings = r.get_vec<uint8_t>(broodwar ? 61 : 46);
 			if (broodwar) r.get<uint8_t>();
 			auto mineral_cost = r.get_vec<uint16_t>(broodwar ? 61 : 46);
@@ -21463,6 +22790,7 @@ struct game_load_functions : state_functions {
 		};
 
 		auto techdata = [&](data_reader_le r, bool broodwar) {
+			if (!load_game_state) return;
 			auto uses_default_settings = r.get_vec<uint8_t>(broodwar ? 44 : 24);
 			auto mineral_cost = r.get_vec<uint16_t>(broodwar ? 44 : 24);
 			auto gas_cost = r.get_vec<uint16_t>(broodwar ? 44 : 24);
@@ -21487,7 +22815,7 @@ struct game_load_functions : state_functions {
 			auto player_uses_global_default = r.get_vec<uint8_t>(12 * count);
 			for (size_t player = 0; player != 12; ++player) {
 				for (size_t upgrade = 0; upgrade != count; ++upgrade) {
-					game_st.max_upgrade_levels[player][(UpgradeTypes)upgrade] = !!player_uses_global_default[player*count + upgrade] ? global_max_level[upgrade] : player_max_level[player*count + upgrade];
+					if (load_game_state) game_st.max_upgrade_levels[player][(UpgradeTypes)upgrade] = !!player_uses_global_default[player*count + upgrade] ? global_max_level[upgrade] : player_max_level[player*count + upgrade];
 					st.upgrade_levels[player][(UpgradeTypes)upgrade] = !!player_uses_global_default[player*count + upgrade] ? global_cur_level[upgrade] : player_cur_level[player*count + upgrade];
 				}
 			}
@@ -21501,7 +22829,7 @@ struct game_load_functions : state_functions {
 			auto player_uses_global_default = r.get_vec<uint8_t>(12 * count);
 			for (size_t player = 0; player != 12; ++player) {
 				for (size_t tech = 0; tech != count; ++tech) {
-					game_st.tech_available[player][(TechTypes)tech] = !!(!!player_uses_global_default[player*count + tech] ? global_available[tech] : player_available[player*count + tech]);
+					if (load_game_state) game_st.tech_available[player][(TechTypes)tech] = !!(!!player_uses_global_default[player*count + tech] ? global_available[tech] : player_available[player*count + tech]);
 					st.tech_researched[player][(TechTypes)tech] = !!(!!player_uses_global_default[player*count + tech] ? global_researched[tech] : player_researched[player*count + tech]);
 				}
 			}
@@ -21521,6 +22849,7 @@ struct game_load_functions : state_functions {
 		};
 		tag_funcs["PUNI"] = [&](data_reader_le r) {
 			if (!use_map_settings) error("wrong game mode");
+			if (!load_game_state) return;
 			auto player_available = r.get_vec<std::array<uint8_t, 228>>(12);
 			auto global_available = r.get_vec<uint8_t>(228);
 			auto player_uses_global_default = r.get_vec<std::array<uint8_t, 228>>(12);
@@ -21593,7 +22922,7 @@ struct game_load_functions : state_functions {
 				const unit_type_t* unit_type = get_unit_type(unit_type_id);
 
 				if (unit_type->id == UnitTypes::Special_Start_Location) {
-					game_st.start_locations[owner] = { x, y };
+					if (load_game_state) game_st.start_locations[owner] = { x, y };
 					// todo: some callback to set initial screen position?
 					continue;
 				}
@@ -21699,10 +23028,10 @@ struct game_load_functions : state_functions {
 			}
 		};
 
+		size_t triggers_end = 0;
 		tag_funcs["TRIG"] = [&](data_reader_le r) {
 			while (r.left()) {
-				game_st.triggers.emplace_back();
-				auto& t = game_st.triggers.back();
+				trigger t;
 				for (size_t i = 0; i != 16; ++i) {
 					auto& c = t.conditions[i];
 					c.location = r.get<uint32_t>();
@@ -21737,9 +23066,14 @@ struct game_load_functions : state_functions {
 					t.enabled[i] = r.get<uint8_t>() != 0;
 					if (!enabled_for_any && t.enabled[i]) enabled_for_any = true;
 				}
-				if (!enabled_for_any) game_st.triggers.pop_back();
+				if (enabled_for_any) {
+					if (load_game_state) game_st.triggers.push_back(t);
+					++triggers_end;
+				}
 			}
-			for (auto& t : game_st.triggers) {
+			if (triggers_end > game_st.triggers.size()) error("TRIG: game_state trigger count mismatch");
+			for (size_t i = 0; i != triggers_end; ++i) {
+				auto& t = game_st.triggers[i];
 				for (int i = 0; i != 8; ++i) {
 					if (st.players[i].controller != player_t::controller_occupied) continue;
 					if (!t.enabled[i] && !t.enabled.at(17 + st.players[i].force) && !t.enabled[17]) continue;
@@ -21772,6 +23106,7 @@ struct game_load_functions : state_functions {
 			{"VCOD", true}
 		});
 
+		if (load_game_state) reset_game_state();
 		reset();
 
 		for (size_t i = 0; i != 12; ++i) {
@@ -21800,6 +23135,13 @@ struct game_load_functions : state_functions {
 		}
 
 		use_map_settings = setup_info.victory_condition == 0 && setup_info.tournament_mode == 0 && setup_info.starting_units == 0;
+		bool melee_triggers = !use_map_settings && setup_info.victory_condition == 1;
+		if (load_game_state) {
+			game_st.use_map_settings = use_map_settings;
+			game_st.melee_triggers = melee_triggers;
+		} else if (game_st.use_map_settings != use_map_settings || game_st.melee_triggers != melee_triggers) {
+			error("load_map_data: game_state was loaded with different game settings");
+		}
 
 		if (version == 59 || version == 63) {
 			if (use_map_settings) {
@@ -21862,11 +23204,14 @@ struct game_load_functions : state_functions {
 			}
 		} else error("unsupported map version %d", version);
 
-		if (!use_map_settings) {
-			if (setup_info.victory_condition == 1) {
-				data_reader_le r(global_st.melee_trg.data(), global_st.melee_trg.data() + global_st.melee_trg.size());
-				tag_funcs["TRIG"](r);
-			}
+		if (melee_triggers) {
+			data_reader_le r(global_st.melee_trg.data(), global_st.melee_trg.data() + global_st.melee_trg.size());
+			tag_funcs["TRIG"](r);
+		}
+
+		if (load_game_state) {
+			game_st.map_data_hash = hash;
+			game_st.loaded = true;
 		}
 
 		for (auto& v : st.players) v.initially_active = false;
@@ -22331,10 +23676,17 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 
 }
 
+template<typename load_data_file_F>
+std::shared_ptr<const global_state> make_shared_global_state(load_data_file_F&& load_data_file) {
+	auto r = std::make_shared<global_state>();
+	global_init(*r, std::forward<load_data_file_F>(load_data_file));
+	return r;
+}
+
 struct game_player {
 private:
-	std::unique_ptr<global_state> uptr_global_st;
-	std::unique_ptr<game_state> uptr_game_st;
+	std::shared_ptr<const global_state> shared_global_st;
+	std::shared_ptr<game_state> shared_game_st;
 	std::unique_ptr<state> uptr_st;
 	optional<state_functions> opt_funcs;
 public:
@@ -22350,17 +23702,35 @@ public:
 	void init(a_string data_path) {
 		init(data_loading::data_files_directory(std::move(data_path)));
 	}
-	template<typename load_data_file_F>
+	template<typename load_data_file_F, typename std::enable_if<!std::is_convertible<load_data_file_F, std::shared_ptr<const global_state>>::value>::type* = nullptr>
 	void init(load_data_file_F&& load_data_file) {
-		uptr_global_st = std::make_unique<global_state>();
-		uptr_game_st = std::make_unique<game_state>();
+		init(make_shared_global_state(std::forward<load_data_file_F>(load_data_file)));
+	}
+	// Uses an already loaded global_state, which may be shared with other
+	// game_players, including ones running on other threads.
+	void init(std::shared_ptr<const global_state> global_st) {
+		init(std::move(global_st), std::make_shared<game_state>());
+	}
+	// Uses a game_state that may already be loaded by another game_player.
+	// load_map_file will then only reuse it, which requires the same map and
+	// game settings (see game_state::loaded).
+	void init(std::shared_ptr<const global_state> global_st, std::shared_ptr<game_state> game_st) {
+		if (!global_st) error("game_player: null global_state");
+		if (!game_st) error("game_player: null game_state");
+		shared_global_st = std::move(global_st);
+		shared_game_st = std::move(game_st);
 		uptr_st = std::make_unique<state>();
 		state& st = *uptr_st;
-		st.global = uptr_global_st.get();
-		st.game = uptr_game_st.get();
-		global_init(*uptr_global_st, std::forward<load_data_file_F>(load_data_file));
+		st.global = shared_global_st.get();
+		st.game = shared_game_st.get();
 		set_st(st);
 	}
+	const std::shared_ptr<const global_state>& global_st() const {
+		return shared_global_st;
+	}
+	const std::shared_ptr<game_state>& game_st() const {
+		return shared_game_st;
+	}
 	void load_map_file(const a_string& filename, bool initial_processing = true) {
 		if (!opt_funcs) error("game_player: not initialized");
 		game_load_functions game_load_funcs(st());
@@ -0,0 +1,54 @@
+# Runs openbw_bench and openbw_bench_headless with -c over every replay in a
+# directory and fails at the first frame whose state hash differs.
+#
+# Variables:
+# BENCH - path to openbw_bench
+# BENCH_HEADLESS - path to openbw_bench_headless
+# CORPUS - directory of replays; the OPENBW_REPLAY_CORPUS environment
+#          variable is used if it is empty, and the test is skipped if both are
+# DATA_PATH - directory containing the data files, passed to -d (optional)
+# WORK_DIR - directory to write the hash files to
+
+if(NOT CORPUS)
+	set(CORPUS "$ENV{OPENBW_REPLAY_CORPUS}")
+endif()
+if(NOT CORPUS)
+	message("OPENBW_REPLAY_CORPUS is not set, skipping")
+	return()
+endif()
+
+set(data_args)
+if(DATA_PATH)
+	set(data_args -d "${DATA_PATH}")
+endif()
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+foreach(bench normal headless)
+	if(bench STREQUAL "normal")
+		set(exe "${BENCH}")
+	else()
+		set(exe "${BENCH_HEADLESS}")
+	endif()
+	execute_process(COMMAND "${exe}" ${data_args} -c "${WORK_DIR}/${bench}.hashes" "${CORPUS}" RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+	if(NOT result EQUAL 0 OR output MATCHES "error:")
+		message(FATAL_ERROR "${exe} failed:\n${output}")
+	endif()
+endforeach()
+
+execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORK_DIR}/normal.hashes" "${WORK_DIR}/headless.hashes" RESULT_VARIABLE result)
+if(result EQUAL 0)
+	file(STRINGS "${WORK_DIR}/normal.hashes" lines)
+	list(LENGTH lines count)
+	message("${count} frames identical")
+	return()
+endif()
+
+# Each line is the replay, the frame and the hash. A missing line is empty.
+file(STRINGS "${WORK_DIR}/normal.hashes" normal)
+file(STRINGS "${WORK_DIR}/headless.hashes" headless)
+foreach(a b IN ZIP_LISTS normal headless)
+	if(NOT a STREQUAL b)
+		message(FATAL_ERROR "first difference:\n  openbw_bench:          ${a}\n  openbw_bench_headless: ${b}")
+	endif()
+endforeach()
+message(FATAL_ERROR "the hash files differ")
@@ -15,6 +15,7 @@
 #include "static_vector.h"
 #include "intrusive_list.h"
 #include "circular_vector.h"
+#include "block_vector.h"
 
 namespace bwgame {
 
@@ -54,6 +55,9 @@ using a_string = std::basic_string<char, std::char_traits<char>, alloc<char>>;
 template<typename T>
 using a_circular_vector = circular_vector<T, alloc<T>>;
 
+template<typename T, size_t block_size>
+using a_block_vector = block_vector<T, block_size, alloc<T>>;
+
 }
 
 #endif
@@ -46,6 +46,8 @@ static void bw_insert_list(cont_T& cont, T& v) {
 
 template<typename T, size_t max_size, size_t allocation_granularity>
 struct object_container {
+	// Object indices are below capacity.
+	static const size_t capacity = max_size;
 	a_deque<std::array<T, allocation_granularity>> list;
 	intrusive_list<T, default_link_f> free_list;
 	size_t size = 0;
@@ -76,10 +78,21 @@ struct object_container {
 	
 	void grow(bool add_new_to_free) {
 		if (size == max_size) error("object_container: attempt to grow beyond max_size");
-		list.emplace_back();
+		// The chunk already exists if size was reduced by state_snapshot::restore;
+		// it is reused so that objects keep their addresses.
+		if (size / allocation_granularity == list.size()) list.emplace_back();
+		auto& chunk = list[size / allocation_granularity];
+		// Fields that are never written for some objects start out as zero
+		// rather than whatever was in memory, so that they are the same in every
+		// run (see state_hash.h).
+		for (auto& v : chunk) {
+			v.~T();
+			memset((void*)&v, 0, sizeof(T));
+			new (&v) T();
+		}
 		size_t n = std::min(allocation_granularity, max_size - size);
 		for (size_t i = 0; i != n; ++i) {
-			T* obj = &list.back()[i];
+			T* obj = &chunk[i];
 			obj->index = size == 0 ? 0 : max_size - size;
 			if (add_new_to_free) free_list.push_back(*obj);
 			++size;
@@ -270,9 +283,6 @@ struct regions_t {
 		a_vector<region*> walkable_neighbors;
 		a_vector<region*> non_walkable_neighbors;
 
-		mutable int pathfinder_flag = 0; // fixme: remove
-		mutable void* pathfinder_node = nullptr; // fixme: remove
-
 		bool walkable() const {
 			return flags != 0x1ffd;
 		}
@@ -766,7 +776,6 @@ struct unit_t: flingy_t {
 	size_t repulse_index;
 
 	rect unit_finder_bounding_box;
-	std::array<bool, 4> unit_finder_visited;
 	size_t unit_finder_index_from;
 	size_t unit_finder_index_to;
 };
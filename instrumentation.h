@@ -0,0 +1,167 @@
+#ifndef BWGAME_INSTRUMENTATION_H
+#define BWGAME_INSTRUMENTATION_H
+
+#include "util.h"
+
+#include <chrono>
+
+// Opt-in hot path instrumentation for state_functions.
+//
+// Compile with OPENBW_ENABLE_INSTRUMENTATION defined and point
+// state_functions::instrumentation at a recorder to collect per-frame call
+// counts and inclusive wall-clock time for the scopes listed below. Without
+// the define the OPENBW_INSTRUMENT_* macros expand to nothing and
+// state_functions has no instrumentation member, so there is no cost at all.
+//
+// Timings are inclusive; update_unit includes the time of the
+// execute_main_order, pathfinder_find and iscript_execute calls it makes.
+
+namespace bwgame {
+
+namespace instrumentation {
+
+enum scope_id {
+	update_units_dead,
+	update_units_movement,
+	update_units_sprites,
+	update_units_update,
+	update_units_hidden,
+	update_units_cloaked,
+	update_units_map_revealers,
+	update_unit,
+	execute_main_order,
+	pathfinder_find,
+	iscript_execute,
+	reveal_sight_at,
+	bullet_execute,
+	scope_count
+};
+
+static const std::array<const char*, scope_count> scope_names = {
+	"update_units_dead",
+	"update_units_movement",
+	"update_units_sprites",
+	"update_units_update",
+	"update_units_hidden",
+	"update_units_cloaked",
+	"update_units_map_revealers",
+	"update_unit",
+	"execute_main_order",
+	"pathfinder_find",
+	"iscript_execute",
+	"reveal_sight_at",
+	"bullet_execute",
+};
+
+using clock = std::chrono::steady_clock;
+
+struct frame_stats {
+	int frame = 0;
+	std::array<uint32_t, scope_count> count{};
+	std::array<uint64_t, scope_count> nanoseconds{};
+};
+
+// Keeps the stats of the last capacity frames in a ring buffer.
+struct recorder {
+	a_vector<frame_stats> frames;
+	size_t next_index = 0;
+	size_t size = 0;
+	frame_stats* current = nullptr;
+
+	explicit recorder(size_t capacity = 1024) : frames(capacity ? capacity : 1) {}
+
+	void begin_frame(int frame) {
+		current = &frames[next_index];
+		*current = frame_stats();
+		current->frame = frame;
+		next_index = (next_index + 1) % frames.size();
+		if (size != frames.size()) ++size;
+	}
+
+	void clear() {
+		next_index = 0;
+		size = 0;
+		current = nullptr;
+	}
+
+	// Calls f for each recorded frame, oldest first.
+	template<typename F>
+	void for_each_frame(F&& f) const {
+		size_t index = (next_index + frames.size() - size) % frames.size();
+		for (size_t i = 0; i != size; ++i) {
+			f(frames[index]);
+			index = (index + 1) % frames.size();
+		}
+	}
+
+	a_string to_csv() const {
+		a_string r = "frame";
+		for (auto* name : scope_names) r += format(",%s_count,%s_ns", name, name);
+		r += "\n";
+		for_each_frame([&](const frame_stats& v) {
+			r += format("%d", v.frame);
+			for (size_t i = 0; i != scope_count; ++i) {
+				r += format(",%u,%u", v.count[i], v.nanoseconds[i]);
+			}
+			r += "\n";
+		});
+		return r;
+	}
+
+	a_string to_json() const {
+		a_string r = "{\"scopes\":[";
+		for (size_t i = 0; i != scope_count; ++i) {
+			if (i) r += ",";
+			r += format("\"%s\"", scope_names[i]);
+		}
+		r += "],\"frames\":[";
+		bool first = true;
+		for_each_frame([&](const frame_stats& v) {
+			if (!first) r += ",";
+			first = false;
+			r += format("\n{\"frame\":%d,\"count\":[", v.frame);
+			for (size_t i = 0; i != scope_count; ++i) {
+				if (i) r += ",";
+				r += format("%u", v.count[i]);
+			}
+			r += "],\"ns\":[";
+			for (size_t i = 0; i != scope_count; ++i) {
+				if (i) r += ",";
+				r += format("%u", v.nanoseconds[i]);
+			}
+			r += "]}";
+		});
+		r += "\n]}\n";
+		return r;
+	}
+};
+
+struct scope {
+	frame_stats* stats;
+	scope_id id;
+	clock::time_point start;
+	scope(recorder* r, scope_id id) : stats(r ? r->current : nullptr), id(id) {
+		if (stats) start = clock::now();
+	}
+	~scope() {
+		if (!stats) return;
+		++stats->count[id];
+		stats->nanoseconds[id] += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+	}
+	scope(const scope&) = delete;
+	scope& operator=(const scope&) = delete;
+};
+
+}
+
+}
+
+#ifdef OPENBW_ENABLE_INSTRUMENTATION
+#define OPENBW_INSTRUMENT_SCOPE(id) ::bwgame::instrumentation::scope instrumentation_scope_##id(instrumentation, ::bwgame::instrumentation::id)
+#define OPENBW_INSTRUMENT_BEGIN_FRAME(frame) do { if (instrumentation) instrumentation->begin_frame(frame); } while (0)
+#else
+#define OPENBW_INSTRUMENT_SCOPE(id)
+#define OPENBW_INSTRUMENT_BEGIN_FRAME(frame) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef BWGAME_PARALLEL_VISION_H
+#define BWGAME_PARALLEL_VISION_H
+
+#include "bwgame.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace bwgame {
+
+// Applies the sight revealed by units each frame on several threads.
+//
+// Every thread reveals a share of the batch onto its own copy of the tiles,
+// starting from nothing revealed, and the copies are then combined into
+// st.tiles with &. Only the area its share can reach is reset in a copy and
+// combined, so the cost does not grow with the size of the map. Since reveal_sight_at only clears bits and does not depend
+// on what other calls revealed, the result is bit for bit the same as applying
+// the batch in order.
+//
+// Usage:
+//   parallel_vision vision(4);
+//   funcs.sight_batch = &vision;
+//
+// Small batches are applied on the calling thread.
+
+struct parallel_vision: sight_batch_t {
+	size_t min_batch_size = 128;
+
+	explicit parallel_vision(size_t threads) {
+		if (threads < 1) threads = 1;
+		tiles.resize(threads - 1);
+		areas.resize(threads - 1);
+		for (size_t i = 1; i != threads; ++i) {
+			workers.emplace_back([this, i]() {
+				worker(i);
+			});
+		}
+	}
+	parallel_vision(const parallel_vision&) = delete;
+	parallel_vision& operator=(const parallel_vision&) = delete;
+	~parallel_vision() {
+		{
+			std::lock_guard<std::mutex> l(mut);
+			quit = true;
+		}
+		cv.notify_all();
+		for (auto& v : workers) v.join();
+	}
+
+	virtual void apply(state_functions& funcs) override {
+		if (workers.empty() || entries.size() < min_batch_size) {
+			for (auto& v : entries) funcs.reveal_sight_at(funcs.st.tiles.data(), v.pos, v.range, v.reveal_to, v.in_air);
+			return;
+		}
+		// The order does not matter, and sorting by row gives every thread a
+		// band of the map to reset and combine rather than all of it.
+		std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) {
+			return a.pos.y < b.pos.y;
+		});
+		this->funcs = &funcs;
+		run(phase_reveal);
+		run(phase_merge);
+		this->funcs = nullptr;
+	}
+
+private:
+	enum {
+		phase_reveal,
+		phase_merge
+	};
+
+	// tiles[i - 1] belongs to thread i; thread 0 (the caller) reveals directly
+	// into st.tiles.
+	a_vector<a_vector<tile_t>> tiles;
+	// The tiles that the share of thread i can reveal, as areas[i - 1], with
+	// to past the end.
+	a_vector<rect_t<xy_t<size_t>>> areas;
+	a_vector<std::thread> workers;
+	std::mutex mut;
+	std::condition_variable cv;
+	std::condition_variable done_cv;
+	size_t generation = 0;
+	size_t remaining = 0;
+	int phase = phase_reveal;
+	bool quit = false;
+	state_functions* funcs = nullptr;
+
+	void run(int new_phase) {
+		{
+			std::lock_guard<std::mutex> l(mut);
+			phase = new_phase;
+			remaining = workers.size();
+			++generation;
+		}
+		cv.notify_all();
+		work(0);
+		std::unique_lock<std::mutex> l(mut);
+		done_cv.wait(l, [&]() {
+			return remaining == 0;
+		});
+	}
+
+	void worker(size_t index) {
+		size_t current_generation = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> l(mut);
+				cv.wait(l, [&]() {
+					return quit || generation != current_generation;
+				});
+				if (quit) return;
+				current_generation = generation;
+			}
+			work(index);
+			bool done;
+			{
+				std::lock_guard<std::mutex> l(mut);
+				done = --remaining == 0;
+			}
+			if (done) done_cv.notify_one();
+		}
+	}
+
+	void work(size_t index) {
+		size_t threads = workers.size() + 1;
+		auto& st_tiles = funcs->st.tiles;
+		size_t width = funcs->game_st.map_tile_width;
+		size_t height = funcs->game_st.map_tile_height;
+		if (phase == phase_reveal) {
+			size_t begin = entries.size() * index / threads;
+			size_t end = entries.size() * (index + 1) / threads;
+			tile_t* dst = st_tiles.data();
+			if (index) {
+				auto& area = areas[index - 1];
+				area.from = {width, height};
+				area.to = {0, 0};
+				for (size_t i = begin; i != end; ++i) {
+					auto& e = entries[i];
+					auto& sight_vals = funcs->game_st.sight_values.at(e.range);
+					size_t tile_x = (size_t)e.pos.x / 32;
+					size_t tile_y = (size_t)e.pos.y / 32;
+					size_t half_width = (size_t)sight_vals.max_width / 2;
+					size_t half_height = (size_t)sight_vals.max_height / 2;
+					area.from.x = std::min(area.from.x, tile_x < half_width ? 0 : tile_x - half_width);
+					area.from.y = std::min(area.from.y, tile_y < half_height ? 0 : tile_y - half_height);
+					area.to.x = std::max(area.to.x, std::min(tile_x + half_width + 1, width));
+					area.to.y = std::max(area.to.y, std::min(tile_y + half_height + 1, height));
+				}
+				// Only the terrain flags of st.tiles are read here, while thread 0
+				// writes visible and explored.
+				auto& v = tiles[index - 1];
+				v.resize(st_tiles.size());
+				for (size_t y = area.from.y; y < area.to.y; ++y) {
+					for (size_t i = y * width + area.from.x; i != y * width + area.to.x; ++i) {
+						v[i].visible = 0xff;
+						v[i].explored = 0xff;
+						v[i].flags = st_tiles[i].flags;
+					}
+				}
+				dst = v.data();
+			}
+			for (size_t i = begin; i != end; ++i) {
+				auto& e = entries[i];
+				funcs->reveal_sight_at(dst, e.pos, e.range, e.reveal_to, e.in_air);
+			}
+		} else {
+			// Split on rows, so that each thread also writes whole rows of
+			// st.vision_bitboards.
+			size_t begin = height * index / threads;
+			size_t end = height * (index + 1) / threads;
+			bool update_bitboards = funcs->st.vision_bitboards.enabled;
+			for (size_t n = 0; n != tiles.size(); ++n) {
+				auto& v = tiles[n];
+				auto& area = areas[n];
+				for (size_t y = std::max(begin, area.from.y); y < std::min(end, area.to.y); ++y) {
+					for (size_t i = y * width + area.from.x; i != y * width + area.to.x; ++i) {
+						st_tiles[i].visible &= v[i].visible;
+						st_tiles[i].explored &= v[i].explored;
+						if (update_bitboards) funcs->vision_bitboards_set(i % width, y, (uint8_t)~v[i].visible, (uint8_t)~v[i].explored);
+					}
+				}
+			}
+		}
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef BWGAME_REGION_DISTANCES_H
+#define BWGAME_REGION_DISTANCES_H
+
+#include "bwgame.h"
+
+#include <cstring>
+#include <functional>
+#include <queue>
+
+namespace bwgame {
+
+// Ground distances between every pair of walkable regions of a map, for
+// answering "how far is A from B by ground" in constant time instead of
+// running a path search.
+//
+// The distance between two regions is the length of the shortest chain of
+// walkable neighbors between them, measured from region center to region
+// center with xy_length. This is the same measure long_path_distance uses
+// for the path that pathfinder_find_long_path finds, but it is always the
+// shortest one, so it can be less than long_path_distance.
+//
+// The table only depends on the map, so it can be built once and shared by
+// any number of states on the same map. Building it runs a search from every
+// walkable region, which takes a while on large maps, so it can be saved and
+// loaded again later. Saved tables record the map data hash and are only
+// loaded for the same map.
+//
+// The table holds 4 bytes for every pair of walkable regions, so it takes
+// walkable_count^2 * 4 bytes: 1 MB for 500 walkable regions, 9 MB for 1500,
+// and about 100 MB at the limit of 5000 regions a map can have.
+//
+// openbw_divergence -g checks a table against long_path_distance.
+//
+// Usage:
+//   region_distance_table dist;
+//   dist.build(funcs);
+//   int d = dist.distance(funcs, from, to);
+
+namespace region_distances {
+
+static const uint32_t magic = 0x4457424f; // "OBWD"
+static const uint32_t version = 1;
+static const size_t header_size = 4 + 4 + 8 + 4 + 4;
+static const uint32_t unreachable = 0xffffffff;
+
+}
+
+struct region_distance_table {
+	uint64_t map_data_hash = 0;
+	size_t region_count = 0;
+	// Region index to index into the rows of distances, or unreachable for
+	// regions that are not walkable.
+	a_vector<uint32_t> walkable_index;
+	size_t walkable_count = 0;
+	a_vector<uint32_t> distances;
+
+	bool empty() const {
+		return region_count == 0;
+	}
+
+	bool is_for(const game_state& game_st) const {
+		return !empty() && map_data_hash == game_st.map_data_hash && region_count == game_st.regions.regions.size();
+	}
+
+	void build(const state_functions& funcs) {
+		auto& regions = funcs.game_st.regions.regions;
+		map_data_hash = funcs.game_st.map_data_hash;
+		region_count = regions.size();
+		walkable_index.assign(region_count, region_distances::unreachable);
+		walkable_count = 0;
+		for (auto& v : regions) {
+			if (v.walkable()) walkable_index[v.index] = (uint32_t)walkable_count++;
+		}
+		distances.assign(walkable_count * walkable_count, region_distances::unreachable);
+
+		using entry = std::pair<uint32_t, const regions_t::region*>;
+		std::priority_queue<entry, a_vector<entry>, std::greater<entry>> open;
+		for (auto& source : regions) {
+			if (!source.walkable()) continue;
+			uint32_t* row = &distances[walkable_index[source.index] * walkable_count];
+			row[walkable_index[source.index]] = 0;
+			open.push({0, &source});
+			while (!open.empty()) {
+				uint32_t d = open.top().first;
+				auto* r = open.top().second;
+				open.pop();
+				if (d != row[walkable_index[r->index]]) continue;
+				xy pos = funcs.to_xy(r->center);
+				for (auto* n : r->walkable_neighbors) {
+					uint32_t nd = d + (uint32_t)funcs.xy_length(funcs.to_xy(n->center) - pos);
+					uint32_t& v = row[walkable_index[n->index]];
+					if (nd < v) {
+						v = nd;
+						open.push({nd, n});
+					}
+				}
+			}
+		}
+	}
+
+	// The distance between the centers of two regions, or unreachable.
+	uint32_t region_distance(const regions_t::region* a, const regions_t::region* b) const {
+		uint32_t ia = walkable_index.at(a->index);
+		uint32_t ib = walkable_index.at(b->index);
+		if (ia == region_distances::unreachable || ib == region_distances::unreachable) return region_distances::unreachable;
+		return distances[ia * walkable_count + ib];
+	}
+
+	// Ground distance from one position to another, with the same special
+	// values as long_path_distance: 0x7fff if to is not reachable from from,
+	// and 0x7ffe if no path was found. Positions in the same or neighboring
+	// regions, or in regions that are not walkable, are measured in a straight
+	// line.
+	int distance(const state_functions& funcs, xy from, xy to) const {
+		if (!is_for(funcs.game_st)) error("region_distance_table::distance: table does not belong to this map");
+		auto* a = funcs.get_region_at(from);
+		auto* b = funcs.get_region_at(to);
+		if (a->group_index != b->group_index) return 0x7fff;
+		if (a == b || !a->walkable() || !b->walkable()) return funcs.xy_length(to - from);
+		if (std::find(a->walkable_neighbors.begin(), a->walkable_neighbors.end(), b) != a->walkable_neighbors.end()) {
+			return funcs.xy_length(to - from);
+		}
+		uint32_t r = region_distance(a, b);
+		if (r == region_distances::unreachable) return 0x7ffe;
+		return (int)std::min(r, (uint32_t)0x7ffd);
+	}
+
+	a_vector<uint8_t> save() const {
+		a_vector<uint8_t> r;
+		auto put = [&](const void* data, size_t size) {
+			r.insert(r.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+		};
+		uint32_t v = region_distances::magic;
+		put(&v, 4);
+		v = region_distances::version;
+		put(&v, 4);
+		put(&map_data_hash, 8);
+		v = (uint32_t)region_count;
+		put(&v, 4);
+		v = (uint32_t)walkable_count;
+		put(&v, 4);
+		put(walkable_index.data(), walkable_index.size() * 4);
+		put(distances.data(), distances.size() * 4);
+		return r;
+	}
+
+	// Loads a table written by save. It must have been built for the map that
+	// is loaded in game_st.
+	void load(const uint8_t* data, size_t data_size, const game_state& game_st) {
+		if (data_size < region_distances::header_size) error("region_distance_table: invalid data");
+		uint32_t file_magic, file_version, file_region_count, file_walkable_count;
+		uint64_t file_map_data_hash;
+		memcpy(&file_magic, data, 4);
+		memcpy(&file_version, data + 4, 4);
+		memcpy(&file_map_data_hash, data + 8, 8);
+		memcpy(&file_region_count, data + 16, 4);
+		memcpy(&file_walkable_count, data + 20, 4);
+		if (file_magic != region_distances::magic) error("region_distance_table: not a region distance table");
+		if (file_version != region_distances::version) error("region_distance_table: unsupported version %d", file_version);
+		if (file_map_data_hash != game_st.map_data_hash || file_region_count != game_st.regions.regions.size()) {
+			error("region_distance_table: table does not belong to this map");
+		}
+		size_t n = (size_t)file_walkable_count;
+		if (n > file_region_count) error("region_distance_table: invalid data");
+		if (data_size - region_distances::header_size != (file_region_count + n * n) * 4) error("region_distance_table: invalid data");
+		const uint8_t* p = data + region_distances::header_size;
+		region_count = 0;
+		walkable_index.resize(file_region_count);
+		memcpy(walkable_index.data(), p, file_region_count * 4);
+		p += file_region_count * 4;
+		for (auto v : walkable_index) {
+			if (v != region_distances::unreachable && v >= n) error("region_distance_table: invalid data");
+		}
+		distances.resize(n * n);
+		memcpy(distances.data(), p, n * n * 4);
+		map_data_hash = file_map_data_hash;
+		region_count = file_region_count;
+		walkable_count = n;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef BWGAME_REGIONS_CACHE_H
+#define BWGAME_REGIONS_CACHE_H
+
+#include "bwgame.h"
+
+#include <atomic>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace bwgame {
+
+// A regions_cache_t that stores each entry as a file in a directory, named
+// after its key. Several processes can share a directory; entries are
+// written to a temporary file that is unique to the writer first and then
+// renamed into place.
+//
+// Usage:
+//   directory_regions_cache cache("cache");
+//   auto game_st = std::make_shared<game_state>();
+//   game_st->regions_cache = &cache;
+//   player.init(global_st, game_st);
+//   player.load_map_file(filename);
+
+struct directory_regions_cache: regions_cache_t {
+	a_string directory;
+
+	explicit directory_regions_cache(a_string directory) : directory(std::move(directory)) {}
+
+	a_string filename(uint64_t key) const {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%016llx.regions", (unsigned long long)key);
+		if (directory.empty()) return buf;
+		return directory + "/" + buf;
+	}
+
+	virtual bool get(uint64_t key, a_vector<uint8_t>& data) override {
+		FILE* f = fopen(filename(key).c_str(), "rb");
+		if (!f) return false;
+		data.clear();
+		uint8_t buf[0x1000];
+		while (size_t n = fread(buf, 1, sizeof(buf), f)) {
+			data.insert(data.end(), buf, buf + n);
+		}
+		bool ok = !ferror(f);
+		fclose(f);
+		return ok;
+	}
+
+	virtual void put(uint64_t key, const a_vector<uint8_t>& data) override {
+		a_string fn = filename(key);
+		static std::atomic<unsigned> counter{0};
+#ifdef _WIN32
+		int pid = _getpid();
+#else
+		int pid = getpid();
+#endif
+		char buf[32];
+		snprintf(buf, sizeof(buf), ".%d.%u.tmp", pid, counter++);
+		a_string tmp_fn = fn + buf;
+		FILE* f = fopen(tmp_fn.c_str(), "wb");
+		if (!f) return;
+		bool ok = fwrite(data.data(), data.size(), 1, f) == 1;
+		ok &= fclose(f) == 0;
+		if (!ok || std::rename(tmp_fn.c_str(), fn.c_str())) std::remove(tmp_fn.c_str());
+	}
+};
+
+}
+
+#endif
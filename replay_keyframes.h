@@ -0,0 +1,183 @@
+#ifndef BWGAME_REPLAY_KEYFRAMES_H
+#define BWGAME_REPLAY_KEYFRAMES_H
+
+#include "replay.h"
+#include "state_serialization.h"
+
+namespace bwgame {
+
+// A keyframe index holds a saved state (see state_serialization.h) every
+// interval frames of a replay, so that seeking to any frame only has to load
+// the nearest preceding keyframe and simulate at most interval - 1 frames.
+//
+// It is meant to be stored next to the replay file. The keyframes are written
+// in order as the replay is played and are followed by a table and a trailer,
+// so the index can be streamed to disk while it is built and mapped into
+// memory for reading:
+//   keyframes: save_state data, each aligned to 8 bytes
+//   table: (frame, offset, size) for each keyframe, as uint64_t
+//   trailer: table offset, keyframe count, interval, replay hash, version, magic
+
+namespace replay_keyframes {
+
+static const uint32_t magic = 0x4b57424f; // "OBWK"
+static const uint32_t version = 1;
+static const size_t trailer_size = 8 + 8 + 8 + 8 + 4 + 4;
+
+// Identifies the replay (and map) an index belongs to.
+static inline uint64_t replay_hash(const replay_state& replay_st, const game_state& game_st) {
+	uint64_t r = 0xcbf29ce484222325;
+	auto add = [&](uint8_t v) {
+		r ^= v;
+		r *= 0x100000001b3;
+	};
+	for (auto v : replay_st.actions_data_buffer) add(v);
+	for (size_t i = 0; i != 4; ++i) add((uint8_t)(replay_st.end_frame >> (8 * i)));
+	for (size_t i = 0; i != 8; ++i) add((uint8_t)(game_st.map_data_hash >> (8 * i)));
+	return r;
+}
+
+}
+
+// Plays the replay loaded into funcs from its current frame to the end and
+// calls write(data, size) with consecutive pieces of the keyframe index.
+// A keyframe is taken at every frame that is a multiple of interval.
+template<typename write_F>
+void write_replay_keyframes(replay_functions& funcs, int interval, write_F&& write) {
+	if (interval <= 0) error("write_replay_keyframes: invalid interval %d", interval);
+	uint64_t pos = 0;
+	auto put = [&](const void* data, size_t size) {
+		write((const uint8_t*)data, size);
+		pos += size;
+	};
+	auto put_u64 = [&](uint64_t v) {
+		put(&v, sizeof(v));
+	};
+	a_vector<uint64_t> table;
+	while (true) {
+		if (funcs.st.current_frame % interval == 0) {
+			a_vector<uint8_t> data = save_state(funcs.st, &funcs.action_st);
+			table.push_back((uint64_t)funcs.st.current_frame);
+			table.push_back(pos);
+			table.push_back(data.size());
+			put(data.data(), data.size());
+			static const uint8_t padding[8] = {};
+			if (pos % 8) put(padding, 8 - pos % 8);
+		}
+		if (funcs.is_done()) break;
+		funcs.next_frame();
+	}
+	uint64_t table_offset = pos;
+	for (auto v : table) put_u64(v);
+	put_u64(table_offset);
+	put_u64(table.size() / 3);
+	put_u64((uint64_t)interval);
+	put_u64(replay_keyframes::replay_hash(funcs.replay_st, *funcs.st.game));
+	uint32_t v = replay_keyframes::version;
+	put(&v, sizeof(v));
+	v = replay_keyframes::magic;
+	put(&v, sizeof(v));
+}
+
+// A read-only view of a keyframe index. The data is not copied and must
+// outlive the index.
+struct replay_keyframe_index {
+	struct keyframe {
+		int frame;
+		const uint8_t* data;
+		size_t size;
+	};
+	a_vector<keyframe> keyframes;
+	int interval = 0;
+	uint64_t replay_hash = 0;
+
+	replay_keyframe_index() = default;
+	replay_keyframe_index(const uint8_t* data, size_t data_size) {
+		load(data, data_size);
+	}
+
+	void load(const uint8_t* data, size_t data_size) {
+		auto get = [&](size_t offset, auto& v) {
+			if (offset > data_size || data_size - offset < sizeof(v)) error("replay_keyframe_index: invalid index");
+			memcpy(&v, data + offset, sizeof(v));
+		};
+		if (data_size < replay_keyframes::trailer_size) error("replay_keyframe_index: invalid index");
+		size_t trailer = data_size - replay_keyframes::trailer_size;
+		uint64_t table_offset, count, file_interval;
+		uint32_t file_version, file_magic;
+		get(trailer, table_offset);
+		get(trailer + 8, count);
+		get(trailer + 16, file_interval);
+		get(trailer + 24, replay_hash);
+		get(trailer + 32, file_version);
+		get(trailer + 36, file_magic);
+		if (file_magic != replay_keyframes::magic) error("replay_keyframe_index: not a keyframe index");
+		if (file_version != replay_keyframes::version) error("replay_keyframe_index: unsupported version %d", file_version);
+		if (table_offset > trailer || (trailer - table_offset) / 24 != count) error("replay_keyframe_index: invalid index");
+		interval = (int)file_interval;
+		keyframes.clear();
+		for (size_t i = 0; i != count; ++i) {
+			uint64_t frame, offset, size;
+			get(table_offset + i * 24, frame);
+			get(table_offset + i * 24 + 8, offset);
+			get(table_offset + i * 24 + 16, size);
+			if (offset > table_offset || table_offset - offset < size) error("replay_keyframe_index: invalid index");
+			if (!keyframes.empty() && (int)frame <= keyframes.back().frame) error("replay_keyframe_index: keyframes out of order");
+			keyframes.push_back({(int)frame, data + offset, (size_t)size});
+		}
+		bound_replay_st = nullptr;
+	}
+
+	// Returns the last keyframe at or before frame, or nullptr.
+	const keyframe* find(int frame) const {
+		auto i = std::upper_bound(keyframes.begin(), keyframes.end(), frame, [](int frame, const keyframe& v) {
+			return frame < v.frame;
+		});
+		if (i == keyframes.begin()) return nullptr;
+		return &*std::prev(i);
+	}
+
+	// Checks that the index belongs to the replay loaded into funcs. seek does
+	// this the first time it is called with a replay, and again if the actions
+	// or end frame of the replay_state it was checked against change; call it
+	// directly after loading another replay into the same replay_state.
+	void bind(const replay_functions& funcs) {
+		bound_replay_st = nullptr;
+		if (replay_hash != replay_keyframes::replay_hash(funcs.replay_st, *funcs.st.game)) error("replay_keyframe_index: index does not belong to this replay");
+		bound_replay_st = &funcs.replay_st;
+		bound_actions = funcs.replay_st.actions_data_buffer.data();
+		bound_actions_size = funcs.replay_st.actions_data_buffer.size();
+		bound_end_frame = funcs.replay_st.end_frame;
+	}
+
+	bool is_bound(const replay_functions& funcs) const {
+		auto& replay_st = funcs.replay_st;
+		if (bound_replay_st != &replay_st) return false;
+		return bound_actions == replay_st.actions_data_buffer.data() && bound_actions_size == replay_st.actions_data_buffer.size() && bound_end_frame == replay_st.end_frame;
+	}
+
+	// Brings the replay loaded into funcs to frame. The nearest keyframe is only
+	// loaded if it is closer than the current frame.
+	void seek(replay_functions& funcs, int frame) {
+		if (frame < 0 || frame > funcs.replay_st.end_frame) error("replay_keyframe_index::seek: frame %d is out of range", frame);
+		if (!is_bound(funcs)) bind(funcs);
+		auto* k = find(frame);
+		if (k && (funcs.st.current_frame > frame || funcs.st.current_frame < k->frame)) {
+			load_state(k->data, k->size, funcs.st, &funcs.action_st);
+		}
+		if (funcs.st.current_frame > frame) error("replay_keyframe_index::seek: can not seek backwards to frame %d", frame);
+		while (funcs.st.current_frame < frame) funcs.next_frame();
+	}
+
+private:
+	// The replay checked by bind, so that seek does not have to hash the
+	// actions every time.
+	const replay_state* bound_replay_st = nullptr;
+	const uint8_t* bound_actions = nullptr;
+	size_t bound_actions_size = 0;
+	int bound_end_frame = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,771 @@
+#ifndef BWGAME_STATE_HASH_H
+#define BWGAME_STATE_HASH_H
+
+#include "bwgame.h"
+
+#include <type_traits>
+
+namespace bwgame {
+
+// Hashes every field of the game state that can affect the simulation, split
+// into sections so that a difference can be narrowed down quickly, and dumps
+// the same fields as text so that two states can be compared field by field.
+//
+// Pointers are replaced by the index of the object (or id of the type) they
+// point to, so the hash of the same game is the same in any process and any
+// build. Objects are visited through the lists that hold them, so only live
+// objects are included and list order is part of the hash.
+//
+// Fields that only matter for drawing (the redraw image flag, visibility of
+// sprites that do not belong to units, selection) and the search bookkeeping
+// of the unit finder are left out, so that headless builds and different unit
+// finder implementations hash the same. So are st.unit_soa and
+// st.vision_bitboards, which only copy fields that are hashed anyway, and
+// st.incremental_vision, which only decides the visibility of tiles.
+
+namespace state_hash {
+
+enum section_t {
+	section_globals,
+	section_units,
+	section_orders,
+	section_paths,
+	section_bullets,
+	section_thingies,
+	section_sprites,
+	section_images,
+	section_tiles,
+	section_creep,
+	section_count
+};
+
+static const std::array<const char*, section_count> section_names = {
+	"globals",
+	"units",
+	"orders",
+	"paths",
+	"bullets",
+	"thingies",
+	"sprites",
+	"images",
+	"tiles",
+	"creep",
+};
+
+template<typename visitor_T>
+struct fields {
+	const state& st;
+	state_functions funcs;
+
+	explicit fields(const state& st) : st(st), funcs(const_cast<state&>(st)) {}
+
+	visitor_T& visitor() {
+		return (visitor_T&)*this;
+	}
+
+	size_t index_of(const unit_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const bullet_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const sprite_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const image_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const order_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	// Thingies have no index; they are identified by their sprite.
+	size_t index_of(const thingy_t* v) {
+		return v ? index_of(v->sprite) : 0;
+	}
+	template<typename T, typename = decltype(std::declval<const T&>().id)>
+	size_t index_of(const T* v) {
+		return v ? (size_t)v->id + 1 : 0;
+	}
+	size_t index_of(const iscript_t::script* v) {
+		return v ? (size_t)(v->id + 1) : 0;
+	}
+	size_t index_of(const grp_t* v) {
+		return v ? v - st.global->grps.data() + 1 : 0;
+	}
+	size_t index_of(const trigger* v) {
+		return v ? v - st.game->triggers.data() + 1 : 0;
+	}
+	size_t index_of(const regions_t::region* v) {
+		return v ? v->index + 1 : 0;
+	}
+
+	template<typename T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type* = nullptr>
+	void value(const char* name, T v) {
+		visitor().leaf(name, (int64_t)v);
+	}
+	template<typename T>
+	auto value(const char* name, T v) -> decltype(v.raw_value, void()) {
+		visitor().leaf(name, (int64_t)v.raw_value);
+	}
+	template<typename T>
+	void value(const char* name, const T* v) {
+		visitor().leaf(name, (int64_t)index_of(v));
+	}
+	template<typename T>
+	void value(const char* name, const xy_t<T>& v) {
+		visitor().enter(name);
+		value("x", v.x);
+		value("y", v.y);
+		visitor().leave();
+	}
+	template<typename T>
+	void value(const char* name, const rect_t<T>& v) {
+		visitor().enter(name);
+		value("from", v.from);
+		value("to", v.to);
+		visitor().leave();
+	}
+	template<typename T>
+	void elements(const char* name, const T& v) {
+		visitor().enter(name);
+		size_t i = 0;
+		for (auto& x : v) {
+			visitor().enter_index(i++);
+			value(nullptr, x);
+			visitor().leave();
+		}
+		visitor().leave();
+	}
+	template<typename T, size_t N>
+	void value(const char* name, const std::array<T, N>& v) {
+		elements(name, v);
+	}
+	template<typename T, typename index_T, size_t N>
+	void value(const char* name, const type_indexed_array<T, index_T, N>& v) {
+		elements(name, v);
+	}
+	template<typename T, size_t N>
+	void value(const char* name, const static_vector<T, N>& v) {
+		visitor().enter(name);
+		value("size", v.size());
+		elements(nullptr, v);
+		visitor().leave();
+	}
+	template<typename T, typename allocator_T>
+	void value(const char* name, const std::vector<T, allocator_T>& v) {
+		visitor().enter(name);
+		value("size", v.size());
+		elements(nullptr, v);
+		visitor().leave();
+	}
+	// circular_vector can not be iterated through a const reference.
+	template<typename T>
+	void circular_vector_value(const char* name, const a_circular_vector<T>& v) {
+		visitor().enter(name);
+		value("size", v.size());
+		for (size_t i = 0; i != v.size(); ++i) {
+			visitor().enter_index(i);
+			value(nullptr, v[i]);
+			visitor().leave();
+		}
+		visitor().leave();
+	}
+	template<typename A, typename B>
+	void value(const char* name, const std::pair<A, B>& v) {
+		visitor().enter(name);
+		value("first", v.first);
+		value("second", v.second);
+		visitor().leave();
+	}
+	template<typename list_T>
+	void list(const char* name, const list_T& list) {
+		visitor().enter(name);
+		size_t i = 0;
+		for (auto& v : list) {
+			visitor().enter_index(i++);
+			value(nullptr, &v);
+			visitor().leave();
+		}
+		value("size", i);
+		visitor().leave();
+	}
+
+	void globals() {
+		value("update_tiles_countdown", st.update_tiles_countdown);
+		value("order_timer_counter", st.order_timer_counter);
+		value("secondary_order_timer_counter", st.secondary_order_timer_counter);
+		value("current_frame", st.current_frame);
+		visitor().enter("players");
+		for (size_t i = 0; i != st.players.size(); ++i) {
+			auto& v = st.players[i];
+			visitor().enter_index(i);
+			value("controller", v.controller);
+			value("race", v.race);
+			value("force", v.force);
+			value("color", v.color);
+			value("initially_active", v.initially_active);
+			value("victory_state", v.victory_state);
+			visitor().leave();
+		}
+		visitor().leave();
+		value("alliances", st.alliances);
+		value("upgrade_levels", st.upgrade_levels);
+		value("upgrade_upgrading", st.upgrade_upgrading);
+		value("tech_researched", st.tech_researched);
+		value("tech_researching", st.tech_researching);
+		value("unit_counts", st.unit_counts);
+		value("completed_unit_counts", st.completed_unit_counts);
+		value("factory_counts", st.factory_counts);
+		value("building_counts", st.building_counts);
+		value("non_building_counts", st.non_building_counts);
+		value("completed_factory_counts", st.completed_factory_counts);
+		value("completed_building_counts", st.completed_building_counts);
+		value("completed_non_building_counts", st.completed_non_building_counts);
+		value("total_buildings_ever_completed", st.total_buildings_ever_completed);
+		value("total_non_buildings_ever_completed", st.total_non_buildings_ever_completed);
+		value("unit_score", st.unit_score);
+		value("building_score", st.building_score);
+		value("supply_used", st.supply_used);
+		value("supply_available", st.supply_available);
+		value("shared_vision", st.shared_vision);
+		value("random_counts", st.random_counts);
+		value("total_random_counts", st.total_random_counts);
+		value("lcg_rand_state", st.lcg_rand_state);
+		value("last_error", st.last_error);
+		value("trigger_timer", st.trigger_timer);
+		visitor().enter("running_triggers");
+		for (size_t i = 0; i != st.running_triggers.size(); ++i) {
+			visitor().enter_index(i);
+			size_t n = 0;
+			for (auto& v : st.running_triggers[i]) {
+				visitor().enter_index(n++);
+				visitor().enter("actions");
+				for (size_t a = 0; a != v.actions.size(); ++a) {
+					visitor().enter_index(a);
+					value("flags", v.actions[a].flags);
+					visitor().leave();
+				}
+				visitor().leave();
+				value("t", v.t);
+				value("flags", v.flags);
+				value("current_action_index", v.current_action_index);
+				visitor().leave();
+			}
+			value("size", n);
+			visitor().leave();
+		}
+		visitor().leave();
+		value("trigger_wait_timers", st.trigger_wait_timers);
+		value("trigger_waiting", st.trigger_waiting);
+		value("active_orders_size", st.active_orders_size);
+		value("active_bullets_size", st.active_bullets_size);
+		value("active_thingies_size", st.active_thingies_size);
+		value("repulse_field", st.repulse_field);
+		value("prev_bullet_heading_offset_clockwise", st.prev_bullet_heading_offset_clockwise);
+		value("current_minerals", st.current_minerals);
+		value("current_gas", st.current_gas);
+		value("total_minerals_gathered", st.total_minerals_gathered);
+		value("total_gas_gathered", st.total_gas_gathered);
+		value("recent_lurker_hits", st.recent_lurker_hits);
+		value("recent_lurker_hit_current_index", st.recent_lurker_hit_current_index);
+		value("update_psionic_matrix", st.update_psionic_matrix);
+		value("disruption_webbed_units", st.disruption_webbed_units);
+		value("cheats_enabled", st.cheats_enabled);
+		value("cheat_operation_cwal", st.cheat_operation_cwal);
+		visitor().enter("locations");
+		for (size_t i = 0; i != st.locations.size(); ++i) {
+			visitor().enter_index(i);
+			value("area", st.locations[i].area);
+			value("elevation_flags", st.locations[i].elevation_flags);
+			visitor().leave();
+		}
+		visitor().leave();
+		for (size_t i = 0; i != st.player_units.size(); ++i) {
+			visitor().enter("player_units");
+			visitor().enter_index(i);
+			list(nullptr, st.player_units[i]);
+			visitor().leave();
+			visitor().leave();
+		}
+		list("cloaked_units", st.cloaked_units);
+		list("psionic_matrix_units", st.psionic_matrix_units);
+		value("consider_collision_with_unit_bug", st.consider_collision_with_unit_bug);
+		value("prev_bullet_source_unit", st.prev_bullet_source_unit);
+	}
+
+	template<typename F>
+	void for_each_unit(F&& f) {
+		for (auto* list : {&st.visible_units, &st.hidden_units, &st.map_revealer_units, &st.dead_units}) {
+			for (const unit_t& u : *list) f(u);
+		}
+	}
+
+	void flingy(const flingy_t& v) {
+		value("hp", v.hp);
+		value("sprite", v.sprite);
+		value("move_target.pos", v.move_target.pos);
+		value("move_target.unit", v.move_target.unit);
+		value("next_movement_waypoint", v.next_movement_waypoint);
+		value("next_target_waypoint", v.next_target_waypoint);
+		value("movement_flags", v.movement_flags);
+		value("heading", v.heading);
+		value("flingy_turn_rate", v.flingy_turn_rate);
+		value("next_velocity_direction", v.next_velocity_direction);
+		value("flingy_type", v.flingy_type);
+		value("flingy_movement_type", v.flingy_movement_type);
+		value("position", v.position);
+		value("exact_position", v.exact_position);
+		value("flingy_top_speed", v.flingy_top_speed);
+		value("current_speed", v.current_speed);
+		value("next_speed", v.next_speed);
+		value("velocity", v.velocity);
+		value("flingy_acceleration", v.flingy_acceleration);
+		value("current_velocity_direction", v.current_velocity_direction);
+		value("desired_velocity_direction", v.desired_velocity_direction);
+		value("order_signal", v.order_signal);
+	}
+
+	void unit(const unit_t& u) {
+		flingy(u);
+		value("owner", u.owner);
+		value("order_type", u.order_type);
+		value("order_state", u.order_state);
+		value("order_unit_type", u.order_unit_type);
+		value("main_order_timer", u.main_order_timer);
+		value("ground_weapon_cooldown", u.ground_weapon_cooldown);
+		value("air_weapon_cooldown", u.air_weapon_cooldown);
+		value("spell_cooldown", u.spell_cooldown);
+		value("order_target.pos", u.order_target.pos);
+		value("order_target.unit", u.order_target.unit);
+		value("shield_points", u.shield_points);
+		value("unit_type", u.unit_type);
+		value("subunit", u.subunit);
+		value("auto_target_unit", u.auto_target_unit);
+		value("connected_unit", u.connected_unit);
+		value("order_queue_count", u.order_queue_count);
+		value("order_process_timer", u.order_process_timer);
+		value("unknown_0x086", u.unknown_0x086);
+		value("attack_notify_timer", u.attack_notify_timer);
+		value("previous_unit_type", u.previous_unit_type);
+		value("last_event_timer", u.last_event_timer);
+		value("last_event_color", u.last_event_color);
+		value("rank_increase", u.rank_increase);
+		value("kill_count", u.kill_count);
+		value("last_attacking_player", u.last_attacking_player);
+		value("secondary_order_timer", u.secondary_order_timer);
+		value("user_action_flags", u.user_action_flags);
+		value("cloak_counter", u.cloak_counter);
+		value("movement_state", u.movement_state);
+		value("build_queue", u.build_queue);
+		value("build_queue_limbo", u.build_queue_limbo);
+		value("energy", u.energy);
+		value("unit_id_generation", u.unit_id_generation);
+		value("secondary_order_type", u.secondary_order_type);
+		value("damage_overlay_state", u.damage_overlay_state);
+		value("hp_construction_rate", u.hp_construction_rate);
+		value("shield_construction_rate", u.shield_construction_rate);
+		value("remaining_build_time", u.remaining_build_time);
+		value("previous_hp", u.previous_hp);
+		value("loaded_units", u.loaded_units);
+		if (u.unit_type) {
+			if (funcs.unit_is_fighter(u.unit_type)) {
+				value("fighter.parent", u.fighter.parent);
+				value("fighter.is_outside", u.fighter.is_outside);
+			} else if (funcs.unit_is_carrier(u.unit_type) || funcs.unit_is_reaver(u.unit_type)) {
+				list("carrier.inside_units", u.carrier.inside_units);
+				list("carrier.outside_units", u.carrier.outside_units);
+				value("carrier.inside_count", u.carrier.inside_count);
+				value("carrier.outside_count", u.carrier.outside_count);
+			} else if (funcs.unit_is_ghost(u.unit_type)) {
+				value("ghost.nuke_dot", u.ghost.nuke_dot);
+			} else if (funcs.unit_is_vulture(u.unit_type)) {
+				value("vulture.spider_mine_count", u.vulture.spider_mine_count);
+			}
+		}
+		value("worker.powerup", u.worker.powerup);
+		value("worker.target_resource_position", u.worker.target_resource_position);
+		value("worker.target_resource_unit", u.worker.target_resource_unit);
+		value("worker.repair_timer", u.worker.repair_timer);
+		value("worker.is_gathering", u.worker.is_gathering);
+		value("worker.resources_carried", u.worker.resources_carried);
+		value("worker.gather_target", u.worker.gather_target);
+		value("building.addon", u.building.addon);
+		value("building.addon_build_type", u.building.addon_build_type);
+		value("building.upgrade_research_time", u.building.upgrade_research_time);
+		value("building.researching_type", u.building.researching_type);
+		value("building.upgrading_type", u.building.upgrading_type);
+		value("building.larva_timer", u.building.larva_timer);
+		value("building.is_landing", u.building.is_landing);
+		value("building.creep_timer", u.building.creep_timer);
+		value("building.upgrading_level", u.building.upgrading_level);
+		value("building.rally.pos", u.building.rally.pos);
+		value("building.rally.unit", u.building.rally.unit);
+		if (u.unit_type) {
+			if (funcs.ut_resource(u.unit_type)) {
+				value("building.resource.resource_count", u.building.resource.resource_count);
+				value("building.resource.resource_iscript", u.building.resource.resource_iscript);
+				value("building.resource.is_being_gathered", u.building.resource.is_being_gathered);
+				list("building.resource.gather_queue", u.building.resource.gather_queue);
+			} else if (funcs.unit_is_nydus(u.unit_type)) {
+				value("building.nydus.exit", u.building.nydus.exit);
+			} else if (funcs.unit_is(u.unit_type, UnitTypes::Terran_Nuclear_Silo)) {
+				value("building.silo.nuke", u.building.silo.nuke);
+				value("building.silo.ready", u.building.silo.ready);
+			} else if (funcs.unit_is(u.unit_type, UnitTypes::Protoss_Pylon)) {
+				value("building.pylon.psi_field_sprite", u.building.pylon.psi_field_sprite);
+			} else if (funcs.ut_powerup(u.unit_type)) {
+				value("building.powerup.origin", u.building.powerup.origin);
+			} else if (funcs.unit_is_hatchery(u.unit_type)) {
+				value("building.hatchery.larva_spawn_side_values", u.building.hatchery.larva_spawn_side_values);
+			}
+		}
+		value("status_flags", u.status_flags);
+		value("carrying_flags", u.carrying_flags);
+		value("wireframe_randomizer", u.wireframe_randomizer);
+		value("secondary_order_state", u.secondary_order_state);
+		value("move_target_timer", u.move_target_timer);
+		value("detected_flags", u.detected_flags);
+		value("current_build_unit", u.current_build_unit);
+		value("pathing_collision_counter", u.pathing_collision_counter);
+		value("pathing_flags", u.pathing_flags);
+		value("unused_0x106", u.unused_0x106);
+		value("is_being_healed", u.is_being_healed);
+		value("terrain_no_collision_bounds", u.terrain_no_collision_bounds);
+		value("remove_timer", u.remove_timer);
+		value("defensive_matrix_hp", u.defensive_matrix_hp);
+		value("defensive_matrix_timer", u.defensive_matrix_timer);
+		value("stim_timer", u.stim_timer);
+		value("ensnare_timer", u.ensnare_timer);
+		value("lockdown_timer", u.lockdown_timer);
+		value("irradiate_timer", u.irradiate_timer);
+		value("stasis_timer", u.stasis_timer);
+		value("plague_timer", u.plague_timer);
+		value("storm_timer", u.storm_timer);
+		value("irradiated_by", u.irradiated_by);
+		value("irradiate_owner", u.irradiate_owner);
+		value("parasite_flags", u.parasite_flags);
+		value("cycle_counter", u.cycle_counter);
+		value("blinded_by", u.blinded_by);
+		value("maelstrom_timer", u.maelstrom_timer);
+		value("acid_spore_count", u.acid_spore_count);
+		value("acid_spore_time", u.acid_spore_time);
+		value("next_hit_near_target_position_index", u.next_hit_near_target_position_index);
+		value("air_strength", u.air_strength);
+		value("ground_strength", u.ground_strength);
+		value("repulse_flags", u.repulse_flags);
+		value("repulse_direction", u.repulse_direction);
+		value("repulse_index", u.repulse_index);
+		value("unit_finder_bounding_box", u.unit_finder_bounding_box);
+	}
+
+	void units() {
+		list("visible_units", st.visible_units);
+		list("hidden_units", st.hidden_units);
+		list("map_revealer_units", st.map_revealer_units);
+		list("dead_units", st.dead_units);
+		for_each_unit([&](const unit_t& u) {
+			visitor().enter("unit");
+			visitor().enter_index(u.index);
+			unit(u);
+			visitor().leave();
+			visitor().leave();
+		});
+	}
+
+	void orders() {
+		for_each_unit([&](const unit_t& u) {
+			visitor().enter("unit");
+			visitor().enter_index(u.index);
+			list("order_queue", u.order_queue);
+			for (const order_t& v : u.order_queue) {
+				visitor().enter("order");
+				visitor().enter_index(v.index);
+				value("order_type", v.order_type);
+				value("target.position", v.target.position);
+				value("target.unit", v.target.unit);
+				value("target.unit_type", v.target.unit_type);
+				visitor().leave();
+				visitor().leave();
+			}
+			visitor().leave();
+			visitor().leave();
+		});
+	}
+
+	void paths() {
+		for_each_unit([&](const unit_t& u) {
+			if (!u.path) return;
+			const path_t& v = *u.path;
+			visitor().enter("unit");
+			visitor().enter_index(u.index);
+			visitor().enter("path");
+			value("delay", v.delay);
+			value("creation_frame", v.creation_frame);
+			value("state_flags", v.state_flags);
+			circular_vector_value("long_path", v.long_path);
+			value("full_long_path_size", v.full_long_path_size);
+			circular_vector_value("short_path", v.short_path);
+			value("current_long_path_index", v.current_long_path_index);
+			value("current_short_path_index", v.current_short_path_index);
+			value("source", v.source);
+			value("destination", v.destination);
+			value("next", v.next);
+			value("last_collision_unit", v.last_collision_unit);
+			value("last_collision_speed", v.last_collision_speed);
+			value("slide_free_direction", v.slide_free_direction);
+			visitor().leave();
+			visitor().leave();
+			visitor().leave();
+		});
+	}
+
+	void bullets() {
+		list("active_bullets", st.active_bullets);
+		for (const bullet_t& b : st.active_bullets) {
+			visitor().enter("bullet");
+			visitor().enter_index(b.index);
+			flingy(b);
+			value("bullet_state", b.bullet_state);
+			value("bullet_target", b.bullet_target);
+			value("bullet_target_pos", b.bullet_target_pos);
+			value("weapon_type", b.weapon_type);
+			value("remaining_time", b.remaining_time);
+			value("hit_flags", b.hit_flags);
+			value("remaining_bounces", b.remaining_bounces);
+			value("owner", b.owner);
+			value("bullet_owner_unit", b.bullet_owner_unit);
+			value("prev_bounce_unit", b.prev_bounce_unit);
+			value("hit_near_target_position_index", b.hit_near_target_position_index);
+			visitor().leave();
+			visitor().leave();
+		}
+	}
+
+	void thingies() {
+		size_t i = 0;
+		for (const thingy_t& t : st.active_thingies) {
+			visitor().enter("thingy");
+			visitor().enter_index(i++);
+			value("hp", t.hp);
+			value("sprite", t.sprite);
+			visitor().leave();
+			visitor().leave();
+		}
+		value("size", i);
+	}
+
+	// Calls f(sprite, is_unit_sprite) for every sprite that belongs to a unit,
+	// bullet or thingy.
+	template<typename F>
+	void for_each_sprite(F&& f) {
+		for_each_unit([&](const unit_t& u) {
+			if (u.sprite) f(*u.sprite, true);
+		});
+		for (const bullet_t& b : st.active_bullets) {
+			if (b.sprite) f(*b.sprite, false);
+		}
+		for (const thingy_t& t : st.active_thingies) {
+			if (t.sprite) f(*t.sprite, false);
+		}
+	}
+
+	void sprites() {
+		for_each_sprite([&](const sprite_t& v, bool is_unit_sprite) {
+			visitor().enter("sprite");
+			visitor().enter_index(v.index);
+			value("sprite_type", v.sprite_type);
+			value("owner", v.owner);
+			if (is_unit_sprite) value("visibility_flags", v.visibility_flags);
+			value("elevation_level", v.elevation_level);
+			value("flags", v.flags & ~sprite_t::flag_selected);
+			value("width", v.width);
+			value("height", v.height);
+			value("position", v.position);
+			value("main_image", v.main_image);
+			list("images", v.images);
+			visitor().leave();
+			visitor().leave();
+		});
+	}
+
+	void images() {
+		for_each_sprite([&](const sprite_t& s, bool) {
+			for (const image_t& v : s.images) {
+				visitor().enter("image");
+				visitor().enter_index(v.index);
+				value("image_type", v.image_type);
+				value("modifier", v.modifier);
+				value("frame_index_offset", v.frame_index_offset);
+				value("flags", v.flags & ~image_t::flag_redraw);
+				value("offset", v.offset);
+				value("iscript_state.current_script", v.iscript_state.current_script);
+				value("iscript_state.program_counter", v.iscript_state.program_counter);
+				value("iscript_state.return_address", v.iscript_state.return_address);
+				value("iscript_state.animation", v.iscript_state.animation);
+				value("iscript_state.wait", v.iscript_state.wait);
+				value("frame_index_base", v.frame_index_base);
+				value("frame_index", v.frame_index);
+				value("grp", v.grp);
+				value("modifier_data1", v.modifier_data1);
+				value("modifier_data2", v.modifier_data2);
+				value("sprite", v.sprite);
+				value("frozen_y_value", v.frozen_y_value);
+				visitor().leave();
+				visitor().leave();
+			}
+		});
+	}
+
+	void tiles() {
+		visitor().enter("tile");
+		for (size_t i = 0; i != st.tiles.size(); ++i) {
+			auto& v = st.tiles[i];
+			visitor().enter_index(i);
+			value("visible", v.visible);
+			value("explored", v.explored);
+			value("flags", v.flags);
+			value("mega_tile_index", st.tiles_mega_tile_index[i]);
+			visitor().leave();
+		}
+		visitor().leave();
+	}
+
+	void creep() {
+		auto& c = st.creep_life;
+		value("recede_timer", c.recede_timer);
+		value("check_dead_unit_timer", c.check_dead_unit_timer);
+		visitor().enter("lists");
+		for (size_t i = 0; i != c.lists.size(); ++i) {
+			visitor().enter_index(i);
+			size_t n = 0;
+			for (auto& v : c.lists[i]) {
+				visitor().enter_index(n++);
+				value("tile_pos", v.tile_pos);
+				value("n_neighboring_creep_tiles", v.n_neighboring_creep_tiles);
+				visitor().leave();
+			}
+			value("size", c.lists_size[i]);
+			visitor().leave();
+		}
+		visitor().leave();
+		value("free_list_size", c.free_list_size);
+	}
+
+	void operator()() {
+		visitor().section(section_globals);
+		globals();
+		visitor().section(section_units);
+		units();
+		visitor().section(section_orders);
+		orders();
+		visitor().section(section_paths);
+		paths();
+		visitor().section(section_bullets);
+		bullets();
+		visitor().section(section_thingies);
+		thingies();
+		visitor().section(section_sprites);
+		sprites();
+		visitor().section(section_images);
+		images();
+		visitor().section(section_tiles);
+		tiles();
+		visitor().section(section_creep);
+		creep();
+	}
+};
+
+struct hashes {
+	std::array<uint64_t, section_count> sections{};
+
+	uint64_t combined() const {
+		uint64_t r = 0xcbf29ce484222325;
+		for (auto v : sections) {
+			r ^= v;
+			r *= 0x100000001b3;
+		}
+		return r;
+	}
+	bool operator==(const hashes& n) const {
+		return sections == n.sections;
+	}
+	bool operator!=(const hashes& n) const {
+		return sections != n.sections;
+	}
+};
+
+struct hasher: fields<hasher> {
+	hashes r;
+	uint64_t* current = nullptr;
+
+	explicit hasher(const state& st) : fields(st) {}
+
+	void section(section_t s) {
+		current = &r.sections[s];
+		*current = 0xcbf29ce484222325;
+	}
+	void enter(const char*) {}
+	void enter_index(size_t) {}
+	void leave() {}
+	void leaf(const char*, int64_t v) {
+		*current ^= (uint64_t)v;
+		*current *= 0x100000001b3;
+	}
+};
+
+// One line per field: "section path = value".
+struct dumper: fields<dumper> {
+	a_string r;
+	const char* section_name = "";
+	a_vector<size_t> path_sizes;
+	a_string path;
+
+	explicit dumper(const state& st) : fields(st) {}
+
+	void section(section_t s) {
+		section_name = section_names[s];
+	}
+	void enter(const char* name) {
+		path_sizes.push_back(path.size());
+		if (name) {
+			if (!path.empty()) path += '.';
+			path += name;
+		}
+	}
+	void enter_index(size_t i) {
+		path_sizes.push_back(path.size());
+		path += format("[%d]", i);
+	}
+	void leave() {
+		path.resize(path_sizes.back());
+		path_sizes.pop_back();
+	}
+	void leaf(const char* name, int64_t v) {
+		r += section_name;
+		r += ' ';
+		r += path;
+		if (name) {
+			if (!path.empty()) r += '.';
+			r += name;
+		}
+		r += format(" = %d\n", v);
+	}
+};
+
+}
+
+static inline state_hash::hashes hash_state(const state& st) {
+	state_hash::hasher h(st);
+	h();
+	return h.r;
+}
+
+static inline a_string dump_state(const state& st) {
+	state_hash::dumper d(st);
+	d();
+	return std::move(d.r);
+}
+
+}
+
+#endif
@@ -0,0 +1,740 @@
+#ifndef BWGAME_STATE_SERIALIZATION_H
+#define BWGAME_STATE_SERIALIZATION_H
+
+#include "bwgame.h"
+#include "actions.h"
+
+#include <type_traits>
+
+namespace bwgame {
+
+// Saves a state (and optionally an action_state) to a single contiguous,
+// position independent buffer, and loads it back.
+//
+// Units, bullets, sprites, images, orders and thingies are stored as their raw
+// bytes in container order, with every pointer replaced by an index (objects)
+// or an id (types), and every intrusive list as a sequence of indices.
+// Loading allocates all objects up front, memcpys them into place, translates
+// the indices back in a single pass and then relinks the lists. Unlike
+// state_copier, no object graph is walked.
+//
+// Objects are stored with the memory layout of the build that saved them, so
+// a buffer can only be loaded by a build with the same layout (this is
+// checked). global and game of the destination state must already be set up,
+// with game loaded from the same map the state was saved from.
+
+namespace state_serialization {
+
+static const uint32_t magic = 0x5357424f; // "OBWS"
+static const uint32_t version = 5;
+
+static inline uint32_t layout_signature() {
+	uint32_t r = (uint32_t)sizeof(void*);
+	for (size_t v : {sizeof(unit_t), sizeof(bullet_t), sizeof(sprite_t), sizeof(image_t), sizeof(order_t), sizeof(thingy_t), sizeof(path_t), sizeof(tile_t)}) {
+		r = r * 31 + (uint32_t)v;
+	}
+	return r;
+}
+
+template<typename io_T>
+struct base {
+	io_T& io() {
+		return (io_T&)*this;
+	}
+
+	template<typename T>
+	void value(T& v) {
+		static_assert(std::is_trivially_copyable<std::remove_const_t<T>>::value, "state_serialization: value must be trivially copyable");
+		io().bytes((void*)&v, sizeof(v));
+	}
+
+	template<typename A, typename B>
+	void value(std::pair<A, B>& v) {
+		value(v.first);
+		value(v.second);
+	}
+
+	template<typename vector_T>
+	void vector(vector_T& v) {
+		static_assert(std::is_trivially_copyable<typename vector_T::value_type>::value, "state_serialization: vector elements must be trivially copyable");
+		size_t n = io().size(v.size());
+		if (!io_T::writing) v.resize(n);
+		if (n) io().bytes((void*)v.data(), n * sizeof(v[0]));
+	}
+
+	template<typename T, size_t max_elements>
+	void static_vector_value(static_vector<T, max_elements>& v) {
+		size_t n = io().size(v.size());
+		if (n > max_elements) error("state_serialization: static_vector too large");
+		if (!io_T::writing) v.resize(n);
+		for (auto& x : v) value(x);
+	}
+
+	template<typename T, size_t max_elements>
+	void static_vector_ref(static_vector<T, max_elements>& v) {
+		size_t n = io().size(v.size());
+		if (n > max_elements) error("state_serialization: static_vector too large");
+		if (!io_T::writing) v.resize(n);
+		for (auto& x : v) io().ref(x);
+	}
+
+	// Everything in state_base_copyable except global and game.
+	void copyable(state& st) {
+		value(st.update_tiles_countdown);
+		value(st.order_timer_counter);
+		value(st.secondary_order_timer_counter);
+		value(st.current_frame);
+		value(st.players);
+		value(st.alliances);
+		value(st.upgrade_levels);
+		value(st.upgrade_upgrading);
+		value(st.tech_researched);
+		value(st.tech_researching);
+		value(st.unit_counts);
+		value(st.completed_unit_counts);
+		value(st.factory_counts);
+		value(st.building_counts);
+		value(st.non_building_counts);
+		value(st.completed_factory_counts);
+		value(st.completed_building_counts);
+		value(st.completed_non_building_counts);
+		value(st.total_buildings_ever_completed);
+		value(st.total_non_buildings_ever_completed);
+		value(st.unit_score);
+		value(st.building_score);
+		value(st.supply_used);
+		value(st.supply_available);
+		value(st.shared_vision);
+		vector(st.tiles);
+		vector(st.tiles_mega_tile_index);
+		value(st.random_counts);
+		value(st.total_random_counts);
+		value(st.lcg_rand_state);
+		value(st.last_error);
+		value(st.trigger_timer);
+		for (auto& list : st.running_triggers) {
+			size_t n = io().size(list.size());
+			if (!io_T::writing) list.resize(n);
+			for (auto& v : list) {
+				value(v.actions);
+				io().ref(v.t);
+				value(v.flags);
+				value(v.current_action_index);
+			}
+		}
+		value(st.trigger_wait_timers);
+		value(st.trigger_waiting);
+		value(st.active_orders_size);
+		value(st.active_bullets_size);
+		value(st.active_thingies_size);
+		vector(st.repulse_field);
+		value(st.prev_bullet_heading_offset_clockwise);
+		value(st.current_minerals);
+		value(st.current_gas);
+		value(st.total_minerals_gathered);
+		value(st.total_gas_gathered);
+		for (auto& v : st.recent_lurker_hits) static_vector_value(v);
+		value(st.recent_lurker_hit_current_index);
+		creep_life(st.creep_life);
+		value(st.update_psionic_matrix);
+		value(st.disruption_webbed_units);
+		value(st.cheats_enabled);
+		value(st.cheat_operation_cwal);
+		vector(st.locations);
+		value(st.unit_soa.enabled);
+		for (auto* v : {&st.unit_soa.from_x, &st.unit_soa.from_y, &st.unit_soa.to_x, &st.unit_soa.to_y}) {
+			vector(*v);
+		}
+		value(st.vision_bitboards.enabled);
+		value(st.vision_bitboards.row_words);
+		for (auto& v : st.vision_bitboards.visible) vector(v);
+		for (auto& v : st.vision_bitboards.explored) vector(v);
+		value(st.incremental_vision.enabled);
+		value(st.incremental_vision.generation);
+		vector(st.incremental_vision.sources);
+		vector(st.incremental_vision.counts);
+		vector(st.incremental_vision.visible_to);
+	}
+
+	void creep_life(creep_life_t& c) {
+		value(c.recede_timer);
+		value(c.check_dead_unit_timer);
+		if (io().size(c.entry_container.size()) != c.entry_container.size()) error("state_serialization: creep entry count mismatch");
+		for (auto& v : c.entry_container) {
+			value(v.tile_pos);
+			value(v.n_neighboring_creep_tiles);
+		}
+		auto entry_list = [&](auto& list) {
+			size_t n = io().size(std::distance(list.begin(), list.end()));
+			if (io_T::writing) {
+				for (auto& v : list) io().size(&v - c.entry_container.data());
+			} else {
+				list.clear();
+				for (size_t i = 0; i != n; ++i) list.push_back(c.entry_container.at(io().size(0)));
+			}
+		};
+		for (auto& v : c.lists) entry_list(v);
+		value(c.lists_size);
+		entry_list(c.free_list);
+		value(c.free_list_size);
+		for (auto& v : c.table.buckets) entry_list(v);
+	}
+
+	void path(path_t& v) {
+		value(v.delay);
+		value(v.creation_frame);
+		value(v.state_flags);
+		size_t n = io().size(v.long_path.size());
+		if (!io_T::writing) v.long_path.resize(n);
+		for (auto& r : v.long_path) io().ref(r);
+		value(v.full_long_path_size);
+		n = io().size(v.short_path.size());
+		if (!io_T::writing) v.short_path.resize(n);
+		for (auto& p : v.short_path) value(p);
+		value(v.current_long_path_index);
+		value(v.current_short_path_index);
+		value(v.source);
+		value(v.destination);
+		value(v.next);
+		value(v.last_collision_unit);
+		value(v.last_collision_speed);
+		value(v.slide_free_direction);
+	}
+
+	// The pointers in objects are translated in place by calling io(pointer).
+	// Intrusive list links are not translated; the lists are relinked from
+	// lists() instead.
+
+	void flingy_pointers(flingy_t& v) {
+		io()(v.sprite);
+		io()(v.move_target.unit);
+		io()(v.flingy_type);
+	}
+
+	void unit_pointers(unit_t& u, const unit_type_t* ut) {
+		auto& funcs = io().funcs;
+		flingy_pointers(u);
+		io()(u.order_type);
+		io()(u.order_unit_type);
+		io()(u.order_target.unit);
+		io()(u.subunit);
+		io()(u.auto_target_unit);
+		io()(u.connected_unit);
+		io()(u.previous_unit_type);
+		io()(u.secondary_order_type);
+		if (ut) {
+			if (funcs.unit_is(ut, UnitTypes::Protoss_Interceptor) || funcs.unit_is(ut, UnitTypes::Protoss_Scarab)) {
+				io()(u.fighter.parent);
+			} else if (funcs.unit_is_ghost(ut)) {
+				io()(u.ghost.nuke_dot);
+			}
+		}
+		io()(u.worker.powerup);
+		io()(u.worker.target_resource_unit);
+		io()(u.worker.gather_target);
+		io()(u.building.addon);
+		io()(u.building.addon_build_type);
+		io()(u.building.researching_type);
+		io()(u.building.upgrading_type);
+		io()(u.building.rally.unit);
+		if (ut) {
+			if (funcs.unit_is_nydus(ut)) {
+				io()(u.building.nydus.exit);
+			} else if (funcs.unit_is(ut, UnitTypes::Terran_Nuclear_Silo)) {
+				io()(u.building.silo.nuke);
+			} else if (funcs.unit_is(ut, UnitTypes::Protoss_Pylon)) {
+				io()(u.building.pylon.psi_field_sprite);
+			}
+		}
+		io()(u.current_build_unit);
+		io()(u.path);
+		io()(u.irradiated_by);
+	}
+
+	void bullet_pointers(bullet_t& v) {
+		flingy_pointers(v);
+		io()(v.bullet_target);
+		io()(v.weapon_type);
+		io()(v.bullet_owner_unit);
+		io()(v.prev_bounce_unit);
+	}
+
+	void sprite_pointers(sprite_t& v) {
+		io()(v.sprite_type);
+		io()(v.main_image);
+	}
+
+	void image_pointers(image_t& v) {
+		io()(v.image_type);
+		io()(v.iscript_state.current_script);
+		io()(v.grp);
+		io()(v.sprite);
+	}
+
+	void order_pointers(order_t& v) {
+		io()(v.order_type);
+		io()(v.target.unit);
+		io()(v.target.unit_type);
+	}
+
+	void thingy_pointers(thingy_t& v) {
+		io()(v.sprite);
+	}
+
+	// Every intrusive list, in the same order as state_copier assembles them.
+	void lists(state& st) {
+		auto& funcs = io().funcs;
+		io().list(st.free_thingies);
+		io().list(st.active_thingies);
+		io().list(st.free_paths);
+		io().list(st.orders_container.free_list);
+		io().list(st.images_container.free_list);
+		io().list(st.sprites_container.free_list);
+		size_t n = io().size(st.sprites_on_tile_line.size());
+		if (n != st.game->map_tile_height) error("state_serialization: map size mismatch");
+		st.sprites_on_tile_line.resize(n);
+		for (auto& v : st.sprites_on_tile_line) io().list(v);
+		io().list(st.bullets_container.free_list);
+		io().list(st.active_bullets);
+		io().list(st.cloaked_units);
+		io().list(st.psionic_matrix_units);
+		for (auto& v : st.player_units) io().list(v);
+		io().list(st.units_container.free_list);
+		io().list(st.dead_units);
+		io().list(st.map_revealer_units);
+		io().list(st.hidden_units);
+		io().list(st.visible_units);
+
+		for (size_t i = 0; i != st.units_container.size; ++i) {
+			unit_t* u = io().slot(st.units_container, i);
+			io().list(u->order_queue);
+			io().static_vector_ref(u->build_queue);
+			io().static_vector_ref(u->build_queue_limbo);
+			if (u->unit_type) {
+				if (funcs.unit_is_carrier(u)) {
+					io().list(u->carrier.inside_units);
+					io().list(u->carrier.outside_units);
+				} else if (funcs.unit_is_reaver(u)) {
+					io().list(u->reaver.inside_units);
+					io().list(u->reaver.outside_units);
+				}
+				if (funcs.ut_resource(u)) {
+					io().list(u->building.resource.gather_queue);
+				}
+			}
+		}
+		for (size_t i = 0; i != st.sprites_container.size; ++i) {
+			io().list(io().slot(st.sprites_container, i)->images);
+		}
+	}
+
+	void unit_finder(state& st) {
+		for (auto* v : {&st.unit_finder_x, &st.unit_finder_y}) {
+			size_t n = io().size(v->size());
+			if (!io_T::writing) {
+				v->clear();
+				for (size_t i = 0; i != n; ++i) v->push_back({});
+			}
+			for (auto& e : *v) {
+				io().ref(e.u);
+				value(e.value);
+			}
+		}
+		io().ref(st.consider_collision_with_unit_bug);
+		io().ref(st.prev_bullet_source_unit);
+	}
+
+	void action_state_fields(action_state& action_st) {
+		value(action_st.player_id);
+		value(action_st.actions_data_position);
+		value(action_st.next_action_frame);
+		for (auto& v : action_st.selection) static_vector_ref(v);
+		for (auto& v : action_st.control_groups) {
+			for (auto& v2 : v) static_vector_value(v2);
+		}
+	}
+};
+
+struct writer: base<writer> {
+	static const bool writing = true;
+
+	a_vector<uint8_t>& data;
+	const state& st;
+	state_functions funcs;
+	a_unordered_map<const path_t*, size_t> path_index;
+	a_unordered_map<const thingy_t*, size_t> thingy_index;
+
+	writer(a_vector<uint8_t>& data, const state& st) : data(data), st(st), funcs(const_cast<state&>(st)) {}
+
+	void bytes(const void* src, size_t n) {
+		data.insert(data.end(), (const uint8_t*)src, (const uint8_t*)src + n);
+	}
+	size_t size(size_t v) {
+		uint32_t n = (uint32_t)v;
+		if (n != v) error("state_serialization: value out of range");
+		value(n);
+		return v;
+	}
+
+	size_t index_of(const unit_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const bullet_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const sprite_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const image_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const order_t* v) {
+		return v ? v->index + 1 : 0;
+	}
+	size_t index_of(const path_t* v) {
+		if (!v) return 0;
+		auto i = path_index.find(v);
+		if (i == path_index.end()) error("state_serialization: unknown path");
+		return i->second + 1;
+	}
+	size_t index_of(const thingy_t* v) {
+		if (!v) return 0;
+		auto i = thingy_index.find(v);
+		if (i == thingy_index.end()) error("state_serialization: unknown thingy");
+		return i->second + 1;
+	}
+	template<typename T, typename = decltype(std::declval<const T&>().id)>
+	size_t index_of(const T* v) {
+		return v ? (size_t)v->id + 1 : 0;
+	}
+	size_t index_of(const iscript_t::script* v) {
+		return v ? (size_t)(v->id + 1) : 0;
+	}
+	size_t index_of(const grp_t* v) {
+		return v ? v - st.global->grps.data() + 1 : 0;
+	}
+	size_t index_of(const trigger* v) {
+		return v ? v - st.game->triggers.data() + 1 : 0;
+	}
+	size_t index_of(const regions_t::region* v) {
+		return v ? v->index + 1 : 0;
+	}
+
+	template<typename T>
+	void operator()(T*& p) {
+		p = (T*)(uintptr_t)index_of(p);
+	}
+	template<typename T>
+	void ref(T* const& p) {
+		size(index_of(p));
+	}
+
+	template<typename T, size_t max_size, size_t allocation_granularity>
+	T* slot(const object_container<T, max_size, allocation_granularity>& c, size_t i) {
+		return const_cast<T*>(&c.list[i / allocation_granularity][i % allocation_granularity]);
+	}
+
+	template<typename list_T>
+	void list(const list_T& list) {
+		size_t n = 0;
+		for (auto i = list.begin(); i != list.end(); ++i) ++n;
+		size(n);
+		for (auto& v : list) ref(&v);
+	}
+
+	template<typename T, typename F>
+	void object(const T& v, F&& f) {
+		std::aligned_storage_t<sizeof(T), alignof(T)> buf;
+		T& tmp = (T&)buf;
+		memcpy((void*)&tmp, (const void*)&v, sizeof(T));
+		tmp.link = {};
+		f(tmp);
+		bytes(&tmp, sizeof(T));
+	}
+
+	template<typename container_T, typename F>
+	void container(const container_T& c, F&& f) {
+		for (size_t i = 0; i != c.size; ++i) object(*slot(c, i), f);
+	}
+
+	void operator()(const action_state* action_st) {
+		state& mst = const_cast<state&>(st);
+
+		value(magic);
+		value(version);
+		uint32_t signature = layout_signature();
+		value(signature);
+		value(st.game->map_data_hash);
+
+		for (auto& v : st.paths) path_index.emplace(&v, path_index.size());
+		for (auto& v : st.thingies) thingy_index.emplace(&v, thingy_index.size());
+
+		size(st.units_container.size);
+		size(st.bullets_container.size);
+		size(st.sprites_container.size);
+		size(st.images_container.size);
+		size(st.orders_container.size);
+		size(st.paths.size());
+		size(st.thingies.size());
+
+		copyable(mst);
+
+		container(st.units_container, [&](unit_t& u) {
+			const unit_type_t* ut = u.unit_type;
+			unit_pointers(u, ut);
+			(*this)(u.unit_type);
+			u.player_units_link = {};
+			u.cloaked_unit_link = {};
+			u.worker.gather_link = {};
+			new (&u.order_queue) decltype(u.order_queue)();
+			new (&u.build_queue) decltype(u.build_queue)();
+			new (&u.build_queue_limbo) decltype(u.build_queue_limbo)();
+		});
+		container(st.bullets_container, [&](bullet_t& v) {
+			bullet_pointers(v);
+		});
+		container(st.sprites_container, [&](sprite_t& v) {
+			sprite_pointers(v);
+			new (&v.images) decltype(v.images)();
+		});
+		container(st.images_container, [&](image_t& v) {
+			image_pointers(v);
+		});
+		container(st.orders_container, [&](order_t& v) {
+			order_pointers(v);
+		});
+		for (auto& v : st.paths) path(const_cast<path_t&>(v));
+		for (auto& v : st.thingies) {
+			object(v, [&](thingy_t& v) {
+				thingy_pointers(v);
+			});
+		}
+
+		lists(mst);
+		unit_finder(mst);
+
+		uint8_t has_action_state = action_st ? 1 : 0;
+		value(has_action_state);
+		if (action_st) action_state_fields(const_cast<action_state&>(*action_st));
+	}
+};
+
+struct reader: base<reader> {
+	static const bool writing = false;
+
+	const uint8_t* ptr;
+	const uint8_t* end;
+	state& st;
+	state_functions funcs;
+	a_vector<path_t*> paths;
+	a_vector<thingy_t*> thingies;
+
+	reader(const uint8_t* data, size_t data_size, state& st) : ptr(data), end(data + data_size), st(st), funcs(st) {}
+
+	void bytes(void* dst, size_t n) {
+		if ((size_t)(end - ptr) < n) error("state_serialization: unexpected end of data");
+		memcpy(dst, ptr, n);
+		ptr += n;
+	}
+	size_t size(size_t) {
+		uint32_t n;
+		value(n);
+		return n;
+	}
+
+	unit_t* get(unit_t*, size_t i) {
+		return i ? st.units_container.at(i - 1) : nullptr;
+	}
+	const unit_t* get(const unit_t*, size_t i) {
+		return get((unit_t*)nullptr, i);
+	}
+	bullet_t* get(bullet_t*, size_t i) {
+		return i ? st.bullets_container.at(i - 1) : nullptr;
+	}
+	sprite_t* get(sprite_t*, size_t i) {
+		return i ? st.sprites_container.at(i - 1) : nullptr;
+	}
+	image_t* get(image_t*, size_t i) {
+		return i ? st.images_container.at(i - 1) : nullptr;
+	}
+	order_t* get(order_t*, size_t i) {
+		return i ? st.orders_container.at(i - 1) : nullptr;
+	}
+	path_t* get(path_t*, size_t i) {
+		return i ? paths.at(i - 1) : nullptr;
+	}
+	thingy_t* get(thingy_t*, size_t i) {
+		return i ? thingies.at(i - 1) : nullptr;
+	}
+	const unit_type_t* get(const unit_type_t*, size_t i) {
+		return i ? funcs.get_unit_type((UnitTypes)(i - 1)) : nullptr;
+	}
+	const weapon_type_t* get(const weapon_type_t*, size_t i) {
+		return i ? funcs.get_weapon_type((WeaponTypes)(i - 1)) : nullptr;
+	}
+	const upgrade_type_t* get(const upgrade_type_t*, size_t i) {
+		return i ? funcs.get_upgrade_type((UpgradeTypes)(i - 1)) : nullptr;
+	}
+	const tech_type_t* get(const tech_type_t*, size_t i) {
+		return i ? funcs.get_tech_type((TechTypes)(i - 1)) : nullptr;
+	}
+	const flingy_type_t* get(const flingy_type_t*, size_t i) {
+		return i ? funcs.get_flingy_type((FlingyTypes)(i - 1)) : nullptr;
+	}
+	const sprite_type_t* get(const sprite_type_t*, size_t i) {
+		return i ? funcs.get_sprite_type((SpriteTypes)(i - 1)) : nullptr;
+	}
+	const image_type_t* get(const image_type_t*, size_t i) {
+		return i ? funcs.get_image_type((ImageTypes)(i - 1)) : nullptr;
+	}
+	const order_type_t* get(const order_type_t*, size_t i) {
+		return i ? funcs.get_order_type((Orders)(i - 1)) : nullptr;
+	}
+	const iscript_t::script* get(const iscript_t::script*, size_t i) {
+		if (!i) return nullptr;
+		auto s = st.global->iscript.scripts.find((int)(i - 1));
+		if (s == st.global->iscript.scripts.end()) error("state_serialization: invalid iscript id %d", i - 1);
+		return &s->second;
+	}
+	const grp_t* get(const grp_t*, size_t i) {
+		return i ? &st.global->grps.at(i - 1) : nullptr;
+	}
+	const trigger* get(const trigger*, size_t i) {
+		return i ? &st.game->triggers.at(i - 1) : nullptr;
+	}
+	const regions_t::region* get(const regions_t::region*, size_t i) {
+		return i ? &st.game->regions.regions.at(i - 1) : nullptr;
+	}
+
+	template<typename T>
+	void operator()(T*& p) {
+		p = get(p, (size_t)(uintptr_t)p);
+	}
+	template<typename T>
+	void ref(T*& p) {
+		p = get(p, size(0));
+	}
+
+	template<typename T, size_t max_size, size_t allocation_granularity>
+	T* slot(object_container<T, max_size, allocation_granularity>& c, size_t i) {
+		return &c.list[i / allocation_granularity][i % allocation_granularity];
+	}
+
+	template<typename list_T>
+	void list(list_T& list) {
+		size_t n = size(0);
+		list.clear();
+		for (size_t i = 0; i != n; ++i) {
+			typename list_T::pointer v = nullptr;
+			ref(v);
+			if (!v) error("state_serialization: null list entry");
+			list.push_back(*v);
+		}
+	}
+
+	template<typename T, typename F>
+	void object(T* v, F&& f) {
+		bytes((void*)v, sizeof(T));
+		f(*v);
+	}
+
+	template<typename container_T>
+	void allocate(container_T& c, size_t n) {
+		c = {};
+		while (c.size < n) c.grow(false);
+		if (c.size != n) error("state_serialization: invalid container size");
+	}
+
+	template<typename container_T, typename F>
+	void container(container_T& c, F&& f) {
+		for (size_t i = 0; i != c.size; ++i) object(slot(c, i), f);
+	}
+
+	void operator()(action_state* action_st) {
+		uint32_t file_magic;
+		uint32_t file_version;
+		uint32_t signature;
+		uint64_t map_data_hash;
+		value(file_magic);
+		value(file_version);
+		value(signature);
+		value(map_data_hash);
+		if (file_magic != magic) error("state_serialization: not a saved state");
+		if (file_version != version) error("state_serialization: unsupported version %d", file_version);
+		if (signature != layout_signature()) error("state_serialization: state was saved by an incompatible build");
+		if (!st.game->loaded || st.game->map_data_hash != map_data_hash) error("state_serialization: state was saved on a different map");
+
+		allocate(st.units_container, size(0));
+		allocate(st.bullets_container, size(0));
+		allocate(st.sprites_container, size(0));
+		allocate(st.images_container, size(0));
+		allocate(st.orders_container, size(0));
+		size_t n_paths = size(0);
+		size_t n_thingies = size(0);
+		if (n_paths > 1024 || n_thingies > 500) error("state_serialization: too many paths or thingies");
+		st.paths.clear();
+		st.unused_paths.clear();
+		for (size_t i = 0; i != n_paths; ++i) paths.push_back(&*st.paths.emplace(st.paths.end()));
+		st.thingies.clear();
+		st.unused_thingies.clear();
+		for (size_t i = 0; i != n_thingies; ++i) thingies.push_back(&*st.thingies.emplace(st.thingies.end()));
+
+		copyable(st);
+
+		container(st.units_container, [&](unit_t& u) {
+			new (&u.build_queue) decltype(u.build_queue)();
+			new (&u.build_queue_limbo) decltype(u.build_queue_limbo)();
+			(*this)(u.unit_type);
+			unit_pointers(u, u.unit_type);
+		});
+		container(st.bullets_container, [&](bullet_t& v) {
+			bullet_pointers(v);
+		});
+		container(st.sprites_container, [&](sprite_t& v) {
+			sprite_pointers(v);
+		});
+		container(st.images_container, [&](image_t& v) {
+			image_pointers(v);
+		});
+		container(st.orders_container, [&](order_t& v) {
+			order_pointers(v);
+		});
+		for (auto* v : paths) path(*v);
+		for (auto* v : thingies) {
+			object(v, [&](thingy_t& v) {
+				thingy_pointers(v);
+			});
+		}
+
+		lists(st);
+		unit_finder(st);
+
+		uint8_t has_action_state;
+		value(has_action_state);
+		if (has_action_state) {
+			if (action_st) action_state_fields(*action_st);
+			else {
+				action_state tmp;
+				action_state_fields(tmp);
+			}
+		}
+		if (ptr != end) error("state_serialization: trailing data");
+	}
+};
+
+}
+
+static inline a_vector<uint8_t> save_state(const state& st, const action_state* action_st = nullptr) {
+	a_vector<uint8_t> r;
+	state_serialization::writer(r, st)(action_st);
+	return r;
+}
+
+// st.global and st.game must be set up; everything else in st is replaced.
+static inline void load_state(const uint8_t* data, size_t data_size, state& st, action_state* action_st = nullptr) {
+	state_serialization::reader(data, data_size, st)(action_st);
+}
+
+}
+
+#endif
@@ -431,6 +431,21 @@ public:
 		m_destroy(ptr_end() - 1);
 		--m_end;
 	}
+	iterator insert(const iterator pos, T value) {
+		if (size() == capacity()) throw std::length_error("static_vector resized beyond capacity");
+		pointer p = pos.ptr;
+		if (p == ptr_end()) {
+			new (p) value_type(std::move(value));
+		} else {
+			new (ptr_end()) value_type(std::move(*(ptr_end() - 1)));
+			for (pointer i = ptr_end() - 1; i != p; --i) {
+				*i = std::move(*(i - 1));
+			}
+			*p = std::move(value);
+		}
+		m_end = ptr_end() + 1;
+		return pos;
+	}
 	iterator erase(const iterator pos) {
 		for (pointer i = pos.ptr;;) {
 			pointer ni = i + 1;
@@ -0,0 +1,432 @@
+
+#include "bwgame.h"
+#include "replay.h"
+#include "state_hash.h"
+#include "parallel_vision.h"
+#include "regions_cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using namespace bwgame;
+
+namespace {
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+enum {
+	phase_actions,
+	phase_recede_creep,
+	phase_refresh_tiles,
+	phase_update_units,
+	phase_update_bullets,
+	phase_update_thingies,
+	phase_process_triggers,
+	phase_count
+};
+
+const std::array<const char*, phase_count> phase_names = {
+	"actions", "recede_creep", "refresh_tiles", "update_units", "update_bullets", "update_thingies", "process_triggers"
+};
+
+struct bench_results {
+	size_t replays = 0;
+	size_t failed_replays = 0;
+	size_t frames = 0;
+	bench_clock::duration load_time{};
+	bench_clock::duration frame_time{};
+	std::array<bench_clock::duration, phase_count> phase_time{};
+	size_t unit_finder_flushes = 0;
+	size_t unit_finder_flushed_moves = 0;
+};
+
+struct bench_functions: replay_functions {
+	bench_results& results;
+	bench_functions(state& st, action_state& action_st, replay_state& replay_st, bench_results& results) : replay_functions(st, action_st, replay_st), results(results) {}
+
+	template<typename F>
+	void timed(size_t phase, F&& f) {
+		auto start = bench_clock::now();
+		f();
+		results.phase_time[phase] += bench_clock::now() - start;
+	}
+
+	// Mirrors replay_functions::next_frame and state_functions::process_frame,
+	// with each phase timed separately.
+	void next_frame() {
+		if (st.current_frame == replay_st.end_frame) error("replay: attempt to play past end");
+		timed(phase_actions, [&]() {
+			execute_actions(replay_st.actions_data_buffer.data(), replay_st.actions_data_buffer.data() + replay_st.actions_data_buffer.size());
+		});
+		++st.current_frame;
+		OPENBW_INSTRUMENT_BEGIN_FRAME(st.current_frame);
+		timed(phase_recede_creep, [&]() {
+			recede_creep();
+		});
+		timed(phase_refresh_tiles, [&]() {
+			if (st.update_tiles_countdown == 0) st.update_tiles_countdown = 100;
+			--st.update_tiles_countdown;
+			update_tiles = st.update_tiles_countdown == 0;
+			if (update_tiles) reset_tile_visibility();
+		});
+		timed(phase_update_units, [&]() {
+			update_units();
+		});
+		timed(phase_update_bullets, [&]() {
+			update_bullets();
+		});
+		timed(phase_update_thingies, [&]() {
+			update_thingies();
+		});
+		timed(phase_process_triggers, [&]() {
+			process_triggers();
+		});
+	}
+};
+
+double seconds(bench_clock::duration d) {
+	return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+}
+
+bool ends_with(const a_string& str, const char* suffix) {
+	size_t n = strlen(suffix);
+	if (str.size() < n) return false;
+	for (size_t i = 0; i != n; ++i) {
+		char a = str[str.size() - n + i];
+		if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+		if (a != suffix[i]) return false;
+	}
+	return true;
+}
+
+void add_replay_files(a_vector<a_string>& files, a_string path) {
+#ifndef _WIN32
+	struct stat s;
+	if (stat(path.c_str(), &s) == 0 && S_ISDIR(s.st_mode)) {
+		DIR* dir = opendir(path.c_str());
+		if (!dir) error("failed to open directory %s", path);
+		a_vector<a_string> dir_files;
+		while (dirent* e = readdir(dir)) {
+			a_string name = e->d_name;
+			if (ends_with(name, ".rep")) dir_files.push_back(path + "/" + name);
+		}
+		closedir(dir);
+		std::sort(dir_files.begin(), dir_files.end());
+		for (auto& v : dir_files) files.push_back(std::move(v));
+		return;
+	}
+#endif
+	files.push_back(std::move(path));
+}
+
+#ifdef OPENBW_ENABLE_INSTRUMENTATION
+instrumentation::recorder* bench_recorder = nullptr;
+#endif
+
+FILE* hash_file = nullptr;
+bool batch_unit_finder_reinsert = false;
+bool unit_soa = false;
+bool vision_bitboards = false;
+bool incremental_vision = false;
+
+// Counts how often load_map_data finds regions in the cache given with -g.
+struct counting_regions_cache: regions_cache_t {
+	regions_cache_t& cache;
+	std::atomic<size_t> gets{0};
+	std::atomic<size_t> puts{0};
+	explicit counting_regions_cache(regions_cache_t& cache) : cache(cache) {}
+	virtual bool get(uint64_t key, a_vector<uint8_t>& data) override {
+		++gets;
+		return cache.get(key, data);
+	}
+	virtual void put(uint64_t key, const a_vector<uint8_t>& data) override {
+		++puts;
+		cache.put(key, data);
+	}
+};
+counting_regions_cache* regions_cache = nullptr;
+
+// Loads the map of filename with regions from regions_cache and with newly
+// generated regions, and checks that the regions are the same. The map is
+// loaded with the cache once before, so that its regions are stored if they
+// were not already.
+void check_regions_cache(const global_state& global_st, const a_string& filename) {
+	auto load = [&](regions_cache_t* cache) {
+		game_state game_st;
+		game_st.regions_cache = cache;
+		auto st = std::make_unique<state>();
+		st->global = &global_st;
+		st->game = &game_st;
+		action_state action_st;
+		replay_state replay_st;
+		replay_functions funcs(*st, action_st, replay_st);
+		funcs.load_replay_file(filename);
+		game_load_functions load_funcs(*st);
+		return load_funcs.save_regions(load_funcs.regions_cache_key());
+	};
+	load(regions_cache);
+	if (load(regions_cache) != load(nullptr)) error("regions loaded from the cache differ from generated regions");
+}
+
+void run_replay(const global_state& global_st, game_state& game_st, const a_string& filename, int max_frames, parallel_vision* vision, bench_results& results) {
+	auto st = std::make_unique<state>();
+	st->global = &global_st;
+	st->game = &game_st;
+	action_state action_st;
+	replay_state replay_st;
+	bench_functions funcs(*st, action_st, replay_st, results);
+	funcs.sight_batch = vision;
+	funcs.batch_unit_finder_reinsert = batch_unit_finder_reinsert;
+	if (unit_soa) funcs.enable_unit_soa();
+	if (vision_bitboards) funcs.enable_vision_bitboards();
+	if (incremental_vision) funcs.enable_incremental_vision();
+#ifdef OPENBW_ENABLE_INSTRUMENTATION
+	if (bench_recorder) bench_recorder->clear();
+	funcs.instrumentation = bench_recorder;
+#endif
+
+	auto load_start = bench_clock::now();
+	funcs.load_replay_file(filename);
+	auto load_time = bench_clock::now() - load_start;
+
+	size_t frames = 0;
+	auto start = bench_clock::now();
+	while (!funcs.is_done() && (max_frames < 0 || (int)frames < max_frames)) {
+		funcs.next_frame();
+		++frames;
+		if (hash_file) {
+			uint64_t h = hash_state(*st).combined();
+			fprintf(hash_file, "%s %d %08x%08x\n", filename.c_str(), st->current_frame, (uint32_t)(h >> 32), (uint32_t)h);
+		}
+	}
+	auto frame_time = bench_clock::now() - start;
+
+	results.load_time += load_time;
+	results.frame_time += frame_time;
+	results.frames += frames;
+	results.unit_finder_flushes += funcs.unit_finder_flushes;
+	results.unit_finder_flushed_moves += funcs.unit_finder_flushed_moves;
+	++results.replays;
+
+	printf("%s: %d frames in %.3fs (%.0f fps), load %.3fs\n", filename.c_str(), (int)frames, seconds(frame_time), frames / seconds(frame_time), seconds(load_time));
+}
+
+void print_results(const bench_results& results) {
+	double total = seconds(results.frame_time);
+	printf("\n%d replays (%d failed), %d frames in %.3fs (%.0f fps), load %.3fs\n", (int)results.replays, (int)results.failed_replays, (int)results.frames, total, results.frames / total, seconds(results.load_time));
+	printf("\n%-18s %12s %8s %12s\n", "phase", "total ms", "%", "us/frame");
+	bench_clock::duration phase_total{};
+	for (size_t i = 0; i != phase_count; ++i) {
+		double t = seconds(results.phase_time[i]);
+		printf("%-18s %12.3f %7.2f%% %12.3f\n", phase_names[i], t * 1000.0, total ? t / total * 100.0 : 0.0, results.frames ? t / results.frames * 1000000.0 : 0.0);
+		phase_total += results.phase_time[i];
+	}
+	printf("%-18s %12.3f %7.2f%%\n", "(timer overhead)", (total - seconds(phase_total)) * 1000.0, total ? (total - seconds(phase_total)) / total * 100.0 : 0.0);
+	if (results.unit_finder_flushes) {
+		printf("\nunit finder flushes: %d, %d moves (%.1f per flush)\n", (int)results.unit_finder_flushes, (int)results.unit_finder_flushed_moves, (double)results.unit_finder_flushed_moves / results.unit_finder_flushes);
+	}
+}
+
+void usage(const char* argv0) {
+	printf("usage: %s [-d data_path] [-f max_frames] [-r repeat] [-j threads] [-s] [-c hash_file] [-v threads] [-g directory [-G]] [-u] [-a] [-b] [-n] replay.rep|directory...\n", argv0);
+	printf("  -d  directory containing StarDat.mpq, BrooDat.mpq and Patch_rt.mpq (default: current directory)\n");
+	printf("  -f  stop each replay after this many frames\n");
+	printf("  -r  run every replay this many times\n");
+	printf("  -j  simulate this many replays concurrently, sharing one global_state\n");
+	printf("  -s  load the game_state of each replay once per thread and reuse it for repeats\n");
+	printf("  -c  write a hash of the state after every frame to this file\n");
+	printf("  -v  reveal sight on this many threads per replay\n");
+	printf("  -g  store the regions of each map in this directory and load them from there (see regions_cache_t)\n");
+	printf("  -G  check that the regions loaded from the -g directory are the same as newly generated ones\n");
+	printf("  -u  apply the unit finder moves of the movement loop in batches\n");
+	printf("  -a  keep a structure-of-arrays copy of the unit fields searches test (see unit_soa_t)\n");
+	printf("  -b  keep per-player vision bitboards (see vision_bitboards_t)\n");
+	printf("  -n  count the sight of units and only propagate changes (see incremental_vision_t)\n");
+#ifdef OPENBW_ENABLE_INSTRUMENTATION
+	printf("  -i  write per-frame instrumentation of the last replay to this .json or .csv file\n");
+#endif
+}
+
+}
+
+int main(int argc, char** argv) {
+
+	a_string data_path;
+	int max_frames = -1;
+	int repeat = 1;
+	int threads = 1;
+	int vision_threads = 1;
+	bool share_game_state = false;
+	a_vector<a_string> files;
+	a_string instrumentation_filename;
+	a_string hash_filename;
+	a_string regions_cache_directory;
+	bool check_regions = false;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			a_string arg = argv[i];
+			auto next_arg = [&]() {
+				if (i + 1 >= argc) error("missing argument to %s", arg);
+				return a_string(argv[++i]);
+			};
+			if (arg == "-d") data_path = next_arg();
+			else if (arg == "-f") max_frames = std::atoi(next_arg().c_str());
+			else if (arg == "-r") repeat = std::atoi(next_arg().c_str());
+			else if (arg == "-j") threads = std::atoi(next_arg().c_str());
+			else if (arg == "-i") instrumentation_filename = next_arg();
+			else if (arg == "-s") share_game_state = true;
+			else if (arg == "-c") hash_filename = next_arg();
+			else if (arg == "-v") vision_threads = std::atoi(next_arg().c_str());
+			else if (arg == "-g") regions_cache_directory = next_arg();
+			else if (arg == "-G") check_regions = true;
+			else if (arg == "-u") batch_unit_finder_reinsert = true;
+			else if (arg == "-a") unit_soa = true;
+			else if (arg == "-b") vision_bitboards = true;
+			else if (arg == "-n") incremental_vision = true;
+			else if (arg == "-h" || arg == "--help") {
+				usage(argv[0]);
+				return 0;
+			} else add_replay_files(files, std::move(arg));
+		}
+	} catch (const exception& e) {
+		printf("error: %s\n", e.what());
+		usage(argv[0]);
+		return 1;
+	}
+	if (files.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (threads < 1) threads = 1;
+	if (threads > 1 && !instrumentation_filename.empty()) {
+		printf("error: -i can not be combined with -j\n");
+		return 1;
+	}
+	if (threads > 1 && !hash_filename.empty()) {
+		printf("error: -c can not be combined with -j\n");
+		return 1;
+	}
+	if (check_regions && regions_cache_directory.empty()) {
+		printf("error: -G requires -g\n");
+		return 1;
+	}
+	optional<directory_regions_cache> directory_cache;
+	optional<counting_regions_cache> counting_cache;
+	if (!regions_cache_directory.empty()) {
+		directory_cache.emplace(regions_cache_directory);
+		counting_cache.emplace(*directory_cache);
+		regions_cache = &*counting_cache;
+	}
+
+	std::shared_ptr<const global_state> global_st;
+	try {
+		auto start = bench_clock::now();
+		global_st = make_shared_global_state(data_loading::data_files_directory(data_path));
+		printf("global_init: %.3fs\n", seconds(bench_clock::now() - start));
+	} catch (const exception& e) {
+		printf("error: failed to load data files: %s\n", e.what());
+		return 1;
+	}
+
+#ifdef OPENBW_ENABLE_INSTRUMENTATION
+	optional<instrumentation::recorder> recorder;
+	if (!instrumentation_filename.empty()) {
+		recorder.emplace(max_frames > 0 ? (size_t)max_frames : 100000);
+		bench_recorder = &*recorder;
+	}
+#else
+	if (!instrumentation_filename.empty()) {
+		printf("error: -i requires building with OPENBW_ENABLE_INSTRUMENTATION\n");
+		return 1;
+	}
+#endif
+
+	if (!hash_filename.empty()) {
+		hash_file = fopen(hash_filename.c_str(), "wb");
+		if (!hash_file) {
+			printf("error: failed to open %s for writing\n", hash_filename.c_str());
+			return 1;
+		}
+	}
+
+	// Every thread simulates its own replays; they all share global_st.
+	size_t jobs = files.size() * (size_t)std::max(repeat, 0);
+	std::atomic<size_t> next_job{0};
+	a_vector<bench_results> thread_results(threads);
+	auto worker = [&](bench_results& results) {
+		a_unordered_map<size_t, std::unique_ptr<game_state>> game_states;
+		std::unique_ptr<parallel_vision> vision;
+		if (vision_threads > 1) vision = std::make_unique<parallel_vision>(vision_threads);
+		for (size_t job = next_job++; job < jobs; job = next_job++) {
+			size_t file_index = job % files.size();
+			auto& filename = files[file_index];
+			try {
+				auto& game_st = game_states[share_game_state ? file_index : 0];
+				if (check_regions) check_regions_cache(*global_st, filename);
+				if (!game_st || !share_game_state) {
+					game_st = std::make_unique<game_state>();
+					game_st->regions_cache = regions_cache;
+				}
+				run_replay(*global_st, *game_st, filename, max_frames, vision.get(), results);
+			} catch (const exception& e) {
+				printf("%s: error: %s\n", filename.c_str(), e.what());
+				++results.failed_replays;
+				game_states.erase(file_index);
+			}
+		}
+	};
+	auto start = bench_clock::now();
+	if (threads == 1) worker(thread_results[0]);
+	else {
+		a_vector<std::thread> thread_list;
+		for (auto& v : thread_results) thread_list.emplace_back(worker, std::ref(v));
+		for (auto& v : thread_list) v.join();
+	}
+	auto wall_time = bench_clock::now() - start;
+
+	bench_results results;
+	for (auto& v : thread_results) {
+		results.replays += v.replays;
+		results.failed_replays += v.failed_replays;
+		results.frames += v.frames;
+		results.load_time += v.load_time;
+		results.frame_time += v.frame_time;
+		for (size_t i = 0; i != phase_count; ++i) results.phase_time[i] += v.phase_time[i];
+		results.unit_finder_flushes += v.unit_finder_flushes;
+		results.unit_finder_flushed_moves += v.unit_finder_flushed_moves;
+	}
+
+	print_results(results);
+	if (regions_cache) {
+		printf("\nregions cache: %d maps looked up, %d generated and stored\n", (int)regions_cache->gets, (int)regions_cache->puts);
+	}
+	if (threads > 1) {
+		printf("\n%d threads: wall time %.3fs (%.0f fps); times above are summed over all threads\n", threads, seconds(wall_time), results.frames / seconds(wall_time));
+	}
+
+#ifdef OPENBW_ENABLE_INSTRUMENTATION
+	if (recorder) {
+		a_string data = ends_with(instrumentation_filename, ".csv") ? recorder->to_csv() : recorder->to_json();
+		FILE* f = fopen(instrumentation_filename.c_str(), "wb");
+		if (!f || fwrite(data.data(), data.size(), 1, f) != 1) printf("error: failed to write %s\n", instrumentation_filename.c_str());
+		if (f) fclose(f);
+	}
+#endif
+
+	if (hash_file && fclose(hash_file)) {
+		printf("error: failed to write %s\n", hash_filename.c_str());
+		return 1;
+	}
+
+	return results.failed_replays ? 1 : 0;
+}
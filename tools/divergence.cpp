@@ -0,0 +1,337 @@
+
+#include "bwgame.h"
+#include "replay.h"
+#include "state_hash.h"
+#include "state_serialization.h"
+#include "parallel_vision.h"
+#include "region_distances.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace bwgame;
+
+namespace {
+
+a_vector<uint8_t> read_file(const a_string& filename) {
+	data_loading::file_reader<> r(filename);
+	a_vector<uint8_t> data(r.size());
+	r.get_bytes(data.data(), data.size());
+	return data;
+}
+
+void write_file(const a_string& filename, const a_string& data) {
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (!f) error("failed to open %s for writing", filename);
+	bool ok = data.empty() || fwrite(data.data(), data.size(), 1, f) == 1;
+	if (fclose(f) || !ok) error("failed to write to %s", filename);
+}
+
+a_vector<a_string> read_lines(const a_string& filename) {
+	a_vector<uint8_t> data = read_file(filename);
+	a_vector<a_string> r;
+	a_string line;
+	for (uint8_t c : data) {
+		if (c == '\n') {
+			r.push_back(std::move(line));
+			line.clear();
+		} else line += (char)c;
+	}
+	if (!line.empty()) r.push_back(std::move(line));
+	return r;
+}
+
+// Hash files have one line per frame: the frame followed by the hash of each
+// section, in hex.
+a_string hash_line(int frame, const state_hash::hashes& h) {
+	a_string r = format("%d", frame);
+	for (auto v : h.sections) r += format(" %08x%08x", (uint32_t)(v >> 32), (uint32_t)v);
+	return r + "\n";
+}
+
+bool parse_hash_line(const a_string& line, int& frame, state_hash::hashes& h) {
+	const char* p = line.c_str();
+	char* end;
+	frame = (int)std::strtol(p, &end, 10);
+	if (end == p) return false;
+	for (auto& v : h.sections) {
+		p = end;
+		v = std::strtoull(p, &end, 16);
+		if (end == p) return false;
+	}
+	return true;
+}
+
+a_string different_sections(const state_hash::hashes& a, const state_hash::hashes& b) {
+	a_string r;
+	for (size_t i = 0; i != state_hash::section_count; ++i) {
+		if (a.sections[i] == b.sections[i]) continue;
+		if (!r.empty()) r += ", ";
+		r += state_hash::section_names[i];
+	}
+	return r;
+}
+
+// Prints the first field that differs between two dumps written by dump_state.
+int compare_dumps(const a_string& a_filename, const a_string& b_filename) {
+	a_vector<a_string> a = read_lines(a_filename);
+	a_vector<a_string> b = read_lines(b_filename);
+	size_t n = std::min(a.size(), b.size());
+	for (size_t i = 0; i != n; ++i) {
+		if (a[i] == b[i]) continue;
+		printf("first difference at line %d:\n", (int)i + 1);
+		printf("  %s: %s\n", a_filename.c_str(), a[i].c_str());
+		printf("  %s: %s\n", b_filename.c_str(), b[i].c_str());
+		return 1;
+	}
+	if (a.size() != b.size()) {
+		const a_string& longer = a.size() > b.size() ? a_filename : b_filename;
+		printf("%s has %d more lines, starting with:\n", longer.c_str(), (int)(std::max(a.size(), b.size()) - n));
+		printf("  %s\n", (a.size() > b.size() ? a[n] : b[n]).c_str());
+		return 1;
+	}
+	printf("no differences\n");
+	return 0;
+}
+
+// Checks that st.vision_bitboards matches the tiles.
+void check_vision_bitboards(const state& st) {
+	auto& vb = st.vision_bitboards;
+	size_t width = st.game->map_tile_width;
+	for (size_t i = 0; i != st.tiles.size(); ++i) {
+		size_t index = i / width * vb.row_words + i % width / 64;
+		uint64_t bit = (uint64_t)1 << (i % width % 64);
+		for (size_t p = 0; p != 8; ++p) {
+			bool visible = (vb.visible[p][index] & bit) != 0;
+			bool explored = (vb.explored[p][index] & bit) != 0;
+			if (visible != ((~st.tiles[i].visible & (1 << p)) != 0) || explored != ((~st.tiles[i].explored & (1 << p)) != 0)) {
+				error("frame %d: vision bitboards of player %d differ from tile %d %d", st.current_frame, p, i % width, i / width);
+			}
+		}
+	}
+}
+
+// Saves st with save_state, loads it into a new state with load_state and
+// checks that the loaded state hashes the same.
+void check_save_load(const state& st, const action_state& action_st) {
+	a_vector<uint8_t> data = save_state(st, &action_st);
+	state loaded_st;
+	loaded_st.global = st.global;
+	loaded_st.game = st.game;
+	action_state loaded_action_st;
+	load_state(data.data(), data.size(), loaded_st, &loaded_action_st);
+	state_hash::hashes a = hash_state(st);
+	state_hash::hashes b = hash_state(loaded_st);
+	if (a != b) error("frame %d: the loaded state differs in %s", st.current_frame, different_sections(a, b));
+}
+
+struct rng_t {
+	uint32_t state;
+	uint32_t operator()(uint32_t n) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state % n;
+	}
+};
+
+// Builds a region_distance_table, checks that it is unchanged by save and
+// load, and checks its distances against long_path_distance between random
+// positions. Both measure chains of regions from center to center, and the
+// table always has the shortest chain, so it must not be farther. Positions
+// in the same or neighboring regions, or in regions that are not walkable,
+// are measured in a straight line by distance and can be either side of
+// long_path_distance, so those are only counted.
+void check_region_distances(const state_functions& funcs, size_t pairs) {
+	region_distance_table built;
+	built.build(funcs);
+	a_vector<uint8_t> data = built.save();
+	region_distance_table dist;
+	dist.load(data.data(), data.size(), funcs.game_st);
+	if (dist.save() != data) error("region distances: the loaded table differs from the saved one");
+
+	rng_t rng{0x12345678};
+	size_t straight = 0;
+	size_t straight_farther = 0;
+	size_t search_failed = 0;
+	for (size_t i = 0; i != pairs; ++i) {
+		xy from((int)rng((uint32_t)funcs.game_st.map_width), (int)rng((uint32_t)funcs.game_st.map_height));
+		xy to((int)rng((uint32_t)funcs.game_st.map_width), (int)rng((uint32_t)funcs.game_st.map_height));
+		int d = dist.distance(funcs, from, to);
+		int expected = funcs.long_path_distance(from, to);
+		if (d == 0x7fff || d == 0x7ffe || expected == 0x7fff) {
+			if (d != expected) error("region distances: %d %d to %d %d is %d, long_path_distance %d", from.x, from.y, to.x, to.y, d, expected);
+			continue;
+		}
+		// The long path search gives up when it runs out of nodes.
+		if (expected == 0x7ffe) {
+			++search_failed;
+			continue;
+		}
+		auto* a = funcs.get_region_at(from);
+		auto* b = funcs.get_region_at(to);
+		bool is_neighbor = std::find(a->walkable_neighbors.begin(), a->walkable_neighbors.end(), b) != a->walkable_neighbors.end();
+		if (a == b || !a->walkable() || !b->walkable() || is_neighbor) {
+			++straight;
+			if (d > expected) ++straight_farther;
+			continue;
+		}
+		if (d > expected) error("region distances: %d %d to %d %d is %d, long_path_distance %d", from.x, from.y, to.x, to.y, d, expected);
+	}
+	printf("region distances: %d walkable regions, %d bytes, %d pairs checked\n", (int)dist.walkable_count, (int)data.size(), (int)pairs);
+	printf("  %d measured in a straight line (%d farther than long_path_distance), %d long path searches gave up\n", (int)straight, (int)straight_farther, (int)search_failed);
+}
+
+void usage(const char* argv0) {
+	printf("usage: %s [-d data_path] [-o hash_file | -c hash_file] [-s frame] [-D dump_file] [-v threads] [-l frames] [-g pairs] [-u] [-a] [-b] [-n] replay.rep\n", argv0);
+	printf("       %s -x dump_file dump_file\n", argv0);
+	printf("  -d  directory containing StarDat.mpq, BrooDat.mpq and Patch_rt.mpq (default: current directory)\n");
+	printf("  -o  write the state hash of every frame to this file\n");
+	printf("  -c  compare the state hash of every frame to this file (written with -o by another build or\n");
+	printf("      configuration) and stop at the first frame that differs\n");
+	printf("  -s  stop at this frame\n");
+	printf("  -D  write every field of the state at the last frame played to this file\n");
+	printf("  -v  reveal sight on this many threads\n");
+	printf("  -l  every this many frames, save the state, load it into a new state and check that the\n");
+	printf("      loaded state has the same hash\n");
+	printf("  -g  build a region distance table for the map, check that it saves and loads, and check it\n");
+	printf("      against long_path_distance for this many random pairs of positions\n");
+	printf("  -u  apply the unit finder moves of the movement loop in batches\n");
+	printf("  -a  keep a structure-of-arrays copy of the unit fields searches test (see unit_soa_t)\n");
+	printf("  -b  keep per-player vision bitboards (see vision_bitboards_t) and check them every frame\n");
+	printf("  -n  count the sight of units and only propagate changes (see incremental_vision_t)\n");
+	printf("  -x  print the first field that differs between two dump files\n");
+	printf("\n");
+	printf("To find where build B diverges from build A:\n");
+	printf("  A: %s -o a.hashes replay.rep\n", argv0);
+	printf("  B: %s -c a.hashes -D b.dump replay.rep      (reports frame F)\n", argv0);
+	printf("  A: %s -s F -D a.dump replay.rep\n", argv0);
+	printf("     %s -x a.dump b.dump\n", argv0);
+}
+
+}
+
+int main(int argc, char** argv) {
+
+	a_string data_path;
+	a_string replay_filename;
+	a_string output_filename;
+	a_string compare_filename;
+	a_string dump_filename;
+	a_vector<a_string> diff_filenames;
+	int stop_frame = -1;
+	int vision_threads = 1;
+	int save_load_interval = 0;
+	size_t region_distance_pairs = 0;
+	bool batch_unit_finder_reinsert = false;
+	bool unit_soa = false;
+	bool vision_bitboards = false;
+	bool incremental_vision = false;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			a_string arg = argv[i];
+			auto next_arg = [&]() {
+				if (i + 1 >= argc) error("missing argument to %s", arg);
+				return a_string(argv[++i]);
+			};
+			if (arg == "-d") data_path = next_arg();
+			else if (arg == "-o") output_filename = next_arg();
+			else if (arg == "-c") compare_filename = next_arg();
+			else if (arg == "-s") stop_frame = std::atoi(next_arg().c_str());
+			else if (arg == "-D") dump_filename = next_arg();
+			else if (arg == "-v") vision_threads = std::atoi(next_arg().c_str());
+			else if (arg == "-l") save_load_interval = std::atoi(next_arg().c_str());
+			else if (arg == "-g") region_distance_pairs = (size_t)std::atoi(next_arg().c_str());
+			else if (arg == "-u") batch_unit_finder_reinsert = true;
+			else if (arg == "-a") unit_soa = true;
+			else if (arg == "-b") vision_bitboards = true;
+			else if (arg == "-n") incremental_vision = true;
+			else if (arg == "-x") {
+				diff_filenames.push_back(next_arg());
+				diff_filenames.push_back(next_arg());
+			} else if (arg == "-h" || arg == "--help") {
+				usage(argv[0]);
+				return 0;
+			} else if (replay_filename.empty()) replay_filename = std::move(arg);
+			else error("unexpected argument %s", arg);
+		}
+		if (!diff_filenames.empty()) {
+			if (!replay_filename.empty()) error("-x does not take a replay");
+		} else {
+			if (replay_filename.empty()) error("no replay file");
+			if (!output_filename.empty() && !compare_filename.empty()) error("-o can not be combined with -c");
+		}
+	} catch (const exception& e) {
+		printf("error: %s\n", e.what());
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		if (!diff_filenames.empty()) return compare_dumps(diff_filenames[0], diff_filenames[1]);
+
+		a_vector<a_string> expected;
+		if (!compare_filename.empty()) expected = read_lines(compare_filename);
+
+		auto global_st = make_shared_global_state(data_loading::data_files_directory(data_path));
+		game_state game_st;
+		state st;
+		st.global = global_st.get();
+		st.game = &game_st;
+		action_state action_st;
+		replay_state replay_st;
+		replay_functions funcs(st, action_st, replay_st);
+		std::unique_ptr<parallel_vision> vision;
+		if (vision_threads > 1) {
+			vision = std::make_unique<parallel_vision>(vision_threads);
+			funcs.sight_batch = vision.get();
+		}
+		funcs.batch_unit_finder_reinsert = batch_unit_finder_reinsert;
+		if (unit_soa) funcs.enable_unit_soa();
+		if (vision_bitboards) funcs.enable_vision_bitboards();
+		if (incremental_vision) funcs.enable_incremental_vision();
+		funcs.load_replay_file(replay_filename);
+		if (region_distance_pairs) check_region_distances(funcs, region_distance_pairs);
+
+		a_string output;
+		size_t line = 0;
+		int diverged_frame = -1;
+		bool hash = !output_filename.empty() || !compare_filename.empty();
+		while (true) {
+			if (vision_bitboards) check_vision_bitboards(st);
+			if (save_load_interval > 0 && st.current_frame % save_load_interval == 0) check_save_load(st, action_st);
+			state_hash::hashes h;
+			if (hash) h = hash_state(st);
+			if (!output_filename.empty()) output += hash_line(st.current_frame, h);
+			if (!compare_filename.empty()) {
+				int frame;
+				state_hash::hashes expected_h;
+				if (line == expected.size()) {
+					printf("%s ends at frame %d\n", compare_filename.c_str(), st.current_frame - 1);
+					break;
+				}
+				if (!parse_hash_line(expected[line++], frame, expected_h)) error("%s: invalid line %d", compare_filename, line);
+				if (frame != st.current_frame) error("%s: line %d is frame %d, expected frame %d", compare_filename, line, frame, st.current_frame);
+				if (h != expected_h) {
+					diverged_frame = st.current_frame;
+					printf("frame %d: diverged in %s\n", diverged_frame, different_sections(h, expected_h).c_str());
+					break;
+				}
+			}
+			if (st.current_frame == stop_frame || funcs.is_done()) break;
+			funcs.next_frame();
+		}
+		if (!compare_filename.empty() && diverged_frame == -1) printf("no divergence in %d frames\n", st.current_frame);
+
+		if (!output_filename.empty()) write_file(output_filename, output);
+		if (!dump_filename.empty()) {
+			write_file(dump_filename, dump_state(st));
+			printf("wrote state at frame %d to %s\n", st.current_frame, dump_filename.c_str());
+		}
+		return diverged_frame == -1 ? 0 : 1;
+	} catch (const exception& e) {
+		printf("error: %s\n", e.what());
+		return 1;
+	}
+}
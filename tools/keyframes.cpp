@@ -0,0 +1,113 @@
+
+#include "bwgame.h"
+#include "replay.h"
+#include "replay_keyframes.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace bwgame;
+
+namespace {
+
+using tool_clock = std::chrono::high_resolution_clock;
+
+double seconds(tool_clock::duration d) {
+	return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+}
+
+a_vector<uint8_t> read_file(const a_string& filename) {
+	data_loading::file_reader<> r(filename);
+	a_vector<uint8_t> data(r.size());
+	r.get_bytes(data.data(), data.size());
+	return data;
+}
+
+void usage(const char* argv0) {
+	printf("usage: %s [-d data_path] [-n interval] [-o index_file] [-s frame] replay.rep\n", argv0);
+	printf("  -d  directory containing StarDat.mpq, BrooDat.mpq and Patch_rt.mpq (default: current directory)\n");
+	printf("  -n  frames between keyframes (default: 480)\n");
+	printf("  -o  keyframe index file (default: replay.rep.keyframes)\n");
+	printf("  -s  instead of writing the index, use it to seek to this frame\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+
+	a_string data_path;
+	int interval = 480;
+	a_string replay_filename;
+	a_string index_filename;
+	int seek_frame = -1;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			a_string arg = argv[i];
+			auto next_arg = [&]() {
+				if (i + 1 >= argc) error("missing argument to %s", arg);
+				return a_string(argv[++i]);
+			};
+			if (arg == "-d") data_path = next_arg();
+			else if (arg == "-n") interval = std::atoi(next_arg().c_str());
+			else if (arg == "-o") index_filename = next_arg();
+			else if (arg == "-s") seek_frame = std::atoi(next_arg().c_str());
+			else if (arg == "-h" || arg == "--help") {
+				usage(argv[0]);
+				return 0;
+			} else if (replay_filename.empty()) replay_filename = std::move(arg);
+			else error("unexpected argument %s", arg);
+		}
+		if (replay_filename.empty()) error("no replay file");
+		if (interval <= 0) error("invalid interval %d", interval);
+	} catch (const exception& e) {
+		printf("error: %s\n", e.what());
+		usage(argv[0]);
+		return 1;
+	}
+	if (index_filename.empty()) index_filename = replay_filename + ".keyframes";
+
+	try {
+		auto global_st = make_shared_global_state(data_loading::data_files_directory(data_path));
+		game_state game_st;
+		state st;
+		st.global = global_st.get();
+		st.game = &game_st;
+		action_state action_st;
+		replay_state replay_st;
+		replay_functions funcs(st, action_st, replay_st);
+
+		auto start = tool_clock::now();
+		funcs.load_replay_file(replay_filename);
+		printf("%s: %d frames, loaded in %.3fs\n", replay_filename.c_str(), replay_st.end_frame, seconds(tool_clock::now() - start));
+
+		if (seek_frame < 0) {
+			FILE* f = fopen(index_filename.c_str(), "wb");
+			if (!f) error("failed to open %s for writing", index_filename);
+			size_t keyframe_bytes = 0;
+			start = tool_clock::now();
+			try {
+				write_replay_keyframes(funcs, interval, [&](const uint8_t* data, size_t size) {
+					if (fwrite(data, size, 1, f) != 1) error("failed to write to %s", index_filename);
+					keyframe_bytes += size;
+				});
+			} catch (...) {
+				fclose(f);
+				throw;
+			}
+			if (fclose(f)) error("failed to write to %s", index_filename);
+			printf("%s: %d keyframes, %d bytes, written in %.3fs\n", index_filename.c_str(), replay_st.end_frame / interval + 1, (int)keyframe_bytes, seconds(tool_clock::now() - start));
+		} else {
+			a_vector<uint8_t> data = read_file(index_filename);
+			replay_keyframe_index index(data.data(), data.size());
+			start = tool_clock::now();
+			index.seek(funcs, seek_frame);
+			printf("seek to frame %d: %.3fs\n", st.current_frame, seconds(tool_clock::now() - start));
+		}
+	} catch (const exception& e) {
+		printf("error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
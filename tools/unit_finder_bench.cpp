@@ -0,0 +1,571 @@
+
+#include "bwgame.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace bwgame;
+
+namespace {
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+double milliseconds(bench_clock::duration d) {
+	return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(d).count();
+}
+
+// The sorted vectors the unit finder used before state::unit_finder_list,
+// with the same insert, remove and reinsert as state_functions used to have.
+// Every operation is applied to both, and the resulting sequences must be
+// identical.
+struct reference_unit_finder {
+	using entry = state::unit_finder_entry;
+	a_vector<entry> x;
+	a_vector<entry> y;
+
+	static bool cmp_l(const entry& a, int b) {
+		return a.value < b;
+	}
+
+	void insert(unit_t* u, rect bb) {
+		auto insert = [&](auto& vec, int from_value, int to_value) {
+			vec.insert(std::lower_bound(vec.begin(), vec.end(), from_value, cmp_l), {u, from_value});
+			vec.insert(std::lower_bound(vec.begin(), vec.end(), to_value, cmp_l), {u, to_value});
+		};
+		insert(x, bb.from.x, bb.to.x);
+		insert(y, bb.from.y, bb.to.y);
+	}
+
+	void remove(unit_t* u, rect bb) {
+		auto remove = [&](auto& vec, int value) {
+			auto i = std::lower_bound(vec.begin(), vec.end(), value, cmp_l);
+			while (i->u != u) ++i;
+			vec.erase(i);
+		};
+		remove(x, bb.from.x);
+		remove(x, bb.to.x);
+		remove(y, bb.from.y);
+		remove(y, bb.to.y);
+	}
+
+	void reinsert(unit_t* u, rect old_bb, rect bb) {
+		auto reinsert = [&](auto& vec, int old_value, int new_value) {
+			if (old_value == new_value) return;
+			auto i = std::lower_bound(vec.begin(), vec.end(), old_value, cmp_l);
+			while (i->u != u) ++i;
+			if (new_value > old_value) {
+				auto ni = std::next(i);
+				while (ni != vec.end() && ni->value < new_value) {
+					*i = *ni;
+					++i;
+					++ni;
+				}
+				*i = {u, new_value};
+			} else {
+				while (i != vec.begin()) {
+					auto ni = i;
+					--i;
+					if (i->value <= new_value) {
+						++i;
+						break;
+					}
+					*ni = *i;
+				}
+				*i = {u, new_value};
+			}
+		};
+		if (bb.from.x <= old_bb.from.x) {
+			reinsert(x, old_bb.from.x, bb.from.x);
+			reinsert(x, old_bb.to.x, bb.to.x);
+		} else {
+			reinsert(x, old_bb.to.x, bb.to.x);
+			reinsert(x, old_bb.from.x, bb.from.x);
+		}
+		if (bb.from.y <= old_bb.from.y) {
+			reinsert(y, old_bb.from.y, bb.from.y);
+			reinsert(y, old_bb.to.y, bb.to.y);
+		} else {
+			reinsert(y, old_bb.to.y, bb.to.y);
+			reinsert(y, old_bb.from.y, bb.from.y);
+		}
+	}
+
+	// find_units with the visited flags in a separate vector indexed by unit;
+	// a unit is returned at its first entry in range that is in bounds.
+	a_vector<bool> visited;
+	void find(rect area, int max_unit_width, int max_unit_height, const unit_t* units, a_vector<unit_t*>& r) {
+		int begin_x = area.from.x;
+		int end_x = area.to.x;
+		if (end_x - begin_x + 1 < max_unit_width) {
+			end_x = begin_x + max_unit_width - 1;
+			++area.to.x;
+		}
+		if (area.to.y - area.from.y + 1 < max_unit_height) ++area.to.y;
+		auto b = std::lower_bound(x.begin(), x.end(), begin_x, cmp_l);
+		auto e = std::lower_bound(x.begin(), x.end(), end_x, cmp_l);
+		for (auto i = b; i != e; ++i) {
+			unit_t* u = i->u;
+			if (u->unit_finder_bounding_box.from.x >= area.to.x) continue;
+			if (u->unit_finder_bounding_box.from.y >= area.to.y) continue;
+			if (u->unit_finder_bounding_box.to.y < area.from.y) continue;
+			if (visited[u - units]) continue;
+			visited[u - units] = true;
+			r.push_back(u);
+		}
+		for (auto i = b; i != e; ++i) visited[i->u - units] = false;
+	}
+
+	// find_nearest_unit over the sorted vectors, one entry at a time. Any
+	// implementation must return the same unit and call the predicate the
+	// same number of times.
+	template<typename F>
+	unit_t* find_nearest(const state_functions& funcs, xy pos, rect search_area, F&& predicate) {
+		auto left_i = std::lower_bound(x.begin(), x.end(), pos.x, cmp_l);
+		auto right_i = left_i;
+		auto up_i = std::lower_bound(y.begin(), y.end(), pos.y, cmp_l);
+		auto down_i = up_i;
+		int best_distance = funcs.xy_length({std::max(pos.x - search_area.from.x, search_area.to.x - pos.x), std::max(pos.y - search_area.from.y, search_area.to.y - pos.y)});
+		unit_t* best_unit = nullptr;
+		auto test = [&](unit_t* u) {
+			int d = funcs.xy_length(pos - u->sprite->position);
+			if (d < best_distance && predicate(u)) {
+				best_distance = d;
+				best_unit = u;
+			}
+		};
+		while (true) {
+			bool done = true;
+			int prev_best_distance = best_distance;
+			if (left_i != x.begin()) {
+				--left_i;
+				done = false;
+				xy p = left_i->u->sprite->position;
+				if (p.x >= search_area.from.x) {
+					if (p.y >= search_area.from.y && p.y < search_area.to.y) test(left_i->u);
+				} else left_i = x.begin();
+			}
+			if (right_i != x.end()) {
+				done = false;
+				xy p = right_i->u->sprite->position;
+				if (p.x < search_area.to.x) {
+					if (p.y >= search_area.from.y && p.y < search_area.to.y) test(right_i->u);
+					++right_i;
+				} else right_i = x.end();
+			}
+			if (up_i != y.begin()) {
+				done = false;
+				--up_i;
+				xy p = up_i->u->sprite->position;
+				if (p.y >= search_area.from.y) {
+					if (p.x >= search_area.from.x && p.x < search_area.to.x) test(up_i->u);
+				} else up_i = y.begin();
+			}
+			if (down_i != y.end()) {
+				done = false;
+				xy p = down_i->u->sprite->position;
+				if (p.y < search_area.to.y) {
+					if (p.x >= search_area.from.x && p.x < search_area.to.x) test(down_i->u);
+					++down_i;
+				} else down_i = y.end();
+			}
+			if (best_distance != prev_best_distance) {
+				if (search_area.from.x < pos.x - best_distance) search_area.from.x = pos.x - best_distance;
+				if (search_area.from.y < pos.y - best_distance) search_area.from.y = pos.y - best_distance;
+				if (search_area.to.x > pos.x + best_distance) search_area.to.x = pos.x + best_distance;
+				if (search_area.to.y > pos.y + best_distance) search_area.to.y = pos.y + best_distance;
+			}
+			if (done) break;
+		}
+		return best_unit;
+	}
+};
+
+template<typename A, typename B>
+bool same_entries(const A& a, const B& b) {
+	if (a.size() != b.size()) return false;
+	auto bi = b.begin();
+	for (auto& v : a) {
+		if (v.u != bi->u || v.value != bi->value) return false;
+		++bi;
+	}
+	return true;
+}
+
+struct rng_t {
+	uint32_t state;
+	uint32_t operator()(uint32_t n) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state % n;
+	}
+};
+
+void usage(const char* argv0) {
+	printf("usage: %s [-n units] [-f frames] [-c units] [-q queries] [-b] [-g percent] [-a] [-r]\n", argv0);
+	printf("  -n  number of units (default: 1500)\n");
+	printf("  -f  number of frames (default: 1000)\n");
+	printf("  -c  units removed or inserted per frame (default: 1%% of units)\n");
+	printf("  -q  find_units and find_nearest_unit queries per frame (default: 200)\n");
+	printf("  -b  reinsert the units of each frame in one batch (see unit_finder_flush)\n");
+	printf("  -g  this percentage of units read the lists before they move, like the unit collision\n");
+	printf("      check of ground units does, which flushes the batch (default: 0)\n");
+	printf("  -a  also time unit_soa_find_units, which tests every unit in state::unit_soa\n");
+	printf("  -r  also time the old sorted vector implementation and check that the order of\n");
+	printf("      every entry and every search result is identical, and check the queries for\n");
+	printf("      bots (find_units_in_radius and the rest) against testing every unit\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+
+	int unit_count = 1500;
+	int frames = 1000;
+	int queries = 200;
+	int churn_count = -1;
+	bool reference = false;
+	bool batch = false;
+	int ground_percent = 0;
+	bool soa = false;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			a_string arg = argv[i];
+			auto next_arg = [&]() {
+				if (i + 1 >= argc) error("missing argument to %s", arg);
+				return a_string(argv[++i]);
+			};
+			if (arg == "-n") unit_count = std::atoi(next_arg().c_str());
+			else if (arg == "-f") frames = std::atoi(next_arg().c_str());
+			else if (arg == "-q") queries = std::atoi(next_arg().c_str());
+			else if (arg == "-c") churn_count = std::atoi(next_arg().c_str());
+			else if (arg == "-r") reference = true;
+			else if (arg == "-b") batch = true;
+			else if (arg == "-g") ground_percent = std::atoi(next_arg().c_str());
+			else if (arg == "-a") soa = true;
+			else if (arg == "-h" || arg == "--help") {
+				usage(argv[0]);
+				return 0;
+			} else error("unexpected argument %s", arg);
+		}
+		if (unit_count <= 0) error("invalid number of units %d", unit_count);
+		size_t max_units = decltype(state::units_container)::capacity;
+		if (soa && (size_t)unit_count > max_units) error("-a supports at most %d units", (int)max_units);
+		if (churn_count < 0) churn_count = unit_count / 100 + 1;
+	} catch (const exception& e) {
+		printf("error: %s\n", e.what());
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		// The unit finder only needs the unit bounding boxes and sprite positions,
+		// so no game data is loaded.
+		auto global_st = std::make_unique<global_state>();
+		auto game_st = std::make_unique<game_state>();
+		game_st->max_unit_width = 64;
+		game_st->max_unit_height = 64;
+		auto st = std::make_unique<state>();
+		st->global = global_st.get();
+		st->game = game_st.get();
+		state_functions funcs(*st);
+		if (soa) funcs.enable_unit_soa();
+
+		const int map_size = 256 * 32;
+		rng_t rng{0x12345678};
+		a_vector<sprite_t> sprites(unit_count);
+		a_vector<unit_t> units(unit_count);
+		a_vector<rect> bbs(unit_count);
+		a_vector<xy> sizes(unit_count);
+		a_vector<bool> alive(unit_count);
+		// Every unit has its own type, with dimensions that match its unit finder
+		// bounding box, a few different ids and a weapon for most, so that the
+		// queries for bots can be checked against brute force.
+		a_vector<unit_type_t> unit_types(unit_count);
+		weapon_type_t weapon{};
+		weapon.id = WeaponTypes::Gauss_Rifle;
+		weapon.max_range = 128;
+		const std::array<UnitTypes, 4> unit_type_ids = {UnitTypes::Terran_Marine, UnitTypes::Terran_Ghost, UnitTypes::Terran_Vulture, UnitTypes::Terran_Firebat};
+		for (size_t i = 0; i != 12; ++i) {
+			for (size_t i2 = 0; i2 != 12; ++i2) st->alliances[i][i2] = i == i2;
+		}
+		auto make_bb = [&](int i) {
+			xy pos = sprites[i].position;
+			return rect{pos - sizes[i] / 2, pos + sizes[i] / 2};
+		};
+		for (int i = 0; i != unit_count; ++i) {
+			units[i].index = i;
+			units[i].sprite = &sprites[i];
+			units[i].unit_type = &unit_types[i];
+			units[i].owner = i % 3;
+			units[i].unit_finder_bounding_box = {{-1, -1}, {-1, -1}};
+			sizes[i] = xy(8 + rng(56), 8 + rng(56));
+			// Some unit types have no size, which gives entries with equal values.
+			if (i % 32 == 0) sizes[i] = xy(0, 0);
+			unit_types[i].id = unit_type_ids[i % unit_type_ids.size()];
+			unit_types[i].dimensions = {sizes[i] / 2, sizes[i] / 2};
+			if (i % 5 != 0) unit_types[i].ground_weapon = &weapon;
+			// Units are clustered around a few bases, like they are in a game.
+			xy base(512 + (i % 8) * 896, 512 + (i / 8 % 8) * 896);
+			sprites[i].position = base + xy(rng(1024), rng(1024)) - xy(512, 512);
+		}
+
+		reference_unit_finder ref;
+		ref.visited.resize(unit_count);
+		bench_clock::duration insert_time{};
+		bench_clock::duration reinsert_time{};
+		bench_clock::duration find_time{};
+		bench_clock::duration nearest_time{};
+		bench_clock::duration soa_find_time{};
+		bench_clock::duration ref_insert_time{};
+		bench_clock::duration ref_reinsert_time{};
+		bench_clock::duration ref_find_time{};
+		size_t found = 0;
+		a_vector<unit_t*> results;
+		a_vector<unit_t*> ref_results;
+		a_vector<unit_t*> nearest_results;
+		size_t predicate_calls = 0;
+
+		auto check = [&](int frame) {
+			if (!same_entries(ref.x, st->unit_finder_x) || !same_entries(ref.y, st->unit_finder_y)) {
+				error("frame %d: unit finder entries differ from the sorted vectors", frame);
+			}
+		};
+
+		// The queries for bots (find_units_in_radius and the rest) over a few of
+		// the areas of each frame, checked against testing every unit.
+		a_vector<rect> areas;
+		auto check_bot_queries = [&](int frame) {
+			auto check = [&](const char* name, size_t n, auto& r, a_vector<unit_t*> expected) {
+				if (n != expected.size()) error("frame %d: %s matched %d units, expected %d", frame, name, (int)n, (int)expected.size());
+				if (r.size() != std::min(n, r.capacity())) error("frame %d: %s returned %d units, expected %d", frame, name, (int)r.size(), (int)std::min(n, r.capacity()));
+				std::sort(expected.begin(), expected.end());
+				for (unit_t* u : r) {
+					if (!std::binary_search(expected.begin(), expected.end(), u)) error("frame %d: %s returned a unit that does not match", frame, name);
+				}
+			};
+			// alive is only updated at the end of the frame.
+			auto in_finder = [&](const unit_t* u) {
+				return u->unit_finder_bounding_box.to.x != -1;
+			};
+			auto predicate = [&](unit_t* u) {
+				return u->index % 3 != 0;
+			};
+			for (size_t i = 0; i < areas.size() && i != 20; ++i) {
+				rect area = areas[i];
+				xy pos = (area.from + area.to) / 2;
+				int radius = area.to.x - area.from.x;
+				a_vector<unit_t*> expected;
+				static_vector<unit_t*, 16> r;
+				for (int i2 = 0; i2 != unit_count; ++i2) {
+					unit_t* u = &units[i2];
+					if (in_finder(&units[i2]) && funcs.xy_length(u->sprite->position - pos) <= radius && predicate(u)) expected.push_back(u);
+				}
+				check("find_units_in_radius", funcs.find_units_in_radius(pos, radius, r, predicate), r, expected);
+
+				static_vector<unit_t*, 8> nearest;
+				funcs.find_nearest_units(pos, radius, nearest, predicate);
+				a_vector<int> distances;
+				for (unit_t* u : expected) distances.push_back(funcs.xy_length(u->sprite->position - pos));
+				std::sort(distances.begin(), distances.end());
+				if (nearest.size() != std::min(distances.size(), nearest.capacity())) error("frame %d: find_nearest_units returned %d units, expected %d", frame, (int)nearest.size(), (int)std::min(distances.size(), nearest.capacity()));
+				for (size_t i2 = 0; i2 != nearest.size(); ++i2) {
+					if (!predicate(nearest[i2]) || funcs.xy_length(nearest[i2]->sprite->position - pos) != distances[i2]) error("frame %d: find_nearest_units returned the wrong units", frame);
+				}
+
+				uint32_t owner_mask = 1 + (uint32_t)(frame + i) % 7;
+				unit_type_mask types;
+				types.set(unit_type_ids[(frame + i) % unit_type_ids.size()]);
+				types.set(unit_type_ids[(frame + i + 1) % unit_type_ids.size()]);
+				expected.clear();
+				for (int i2 = 0; i2 != unit_count; ++i2) {
+					unit_t* u = &units[i2];
+					if (!in_finder(&units[i2]) || (~owner_mask & (1u << u->owner)) || !types.test(u->unit_type->id)) continue;
+					if (funcs.is_intersecting(u->unit_finder_bounding_box, area)) expected.push_back(u);
+				}
+				check("find_units_in_rect", funcs.find_units_in_rect(area, owner_mask, types, r), r, expected);
+
+				int index = (frame * 20 + (int)i) % unit_count;
+				if (!in_finder(&units[index])) continue;
+				unit_t* attacker = &units[index];
+				expected.clear();
+				if (attacker->unit_type->ground_weapon) {
+					for (int i2 = 0; i2 != unit_count; ++i2) {
+						unit_t* u = &units[i2];
+						if (!in_finder(&units[i2]) || u == attacker || u->owner == attacker->owner) continue;
+						if (funcs.units_distance(attacker, u) <= weapon.max_range) expected.push_back(u);
+					}
+				}
+				static_vector<unit_t*, 64> enemies;
+				check("find_enemies_in_weapon_range", funcs.find_enemies_in_weapon_range(attacker, enemies), enemies, expected);
+			}
+		};
+
+		auto start = bench_clock::now();
+		for (int i = 0; i != unit_count; ++i) {
+			bbs[i] = make_bb(i);
+			funcs.unit_finder_insert(&units[i], bbs[i]);
+			alive[i] = true;
+		}
+		insert_time += bench_clock::now() - start;
+		if (reference) {
+			start = bench_clock::now();
+			for (int i = 0; i != unit_count; ++i) ref.insert(&units[i], bbs[i]);
+			ref_insert_time += bench_clock::now() - start;
+			check(0);
+		}
+
+		a_vector<rect> new_bbs(unit_count);
+		a_vector<int> churn;
+		areas.resize(queries);
+		for (int frame = 1; frame <= frames; ++frame) {
+			// Most units move a few pixels, a few die or are created.
+			for (int i = 0; i != unit_count; ++i) {
+				if (!alive[i]) continue;
+				xy& pos = sprites[i].position;
+				pos += xy((int)rng(9) - 4, (int)rng(9) - 4);
+				if (pos.x < 32) pos.x = 32;
+				if (pos.y < 32) pos.y = 32;
+				if (pos.x >= map_size - 32) pos.x = map_size - 33;
+				if (pos.y >= map_size - 32) pos.y = map_size - 33;
+				new_bbs[i] = make_bb(i);
+			}
+			churn.clear();
+			for (int i = 0; i != churn_count; ++i) {
+				int index = rng(unit_count);
+				if (std::find(churn.begin(), churn.end(), index) == churn.end()) churn.push_back(index);
+			}
+			for (auto& v : areas) {
+				xy pos(rng(map_size - 256), rng(map_size - 256));
+				v = {pos, pos + xy(32 + rng(224), 32 + rng(224))};
+			}
+
+			start = bench_clock::now();
+			funcs.defer_unit_finder_reinsert = batch;
+			for (int i = 0; i != unit_count; ++i) {
+				if (!alive[i]) continue;
+				if (i % 100 < ground_percent) funcs.unit_finder_flush();
+				funcs.unit_finder_reinsert(&units[i], new_bbs[i]);
+			}
+			funcs.defer_unit_finder_reinsert = false;
+			funcs.unit_finder_flush();
+			auto now = bench_clock::now();
+			reinsert_time += now - start;
+			start = now;
+			for (int i : churn) {
+				if (alive[i]) funcs.unit_finder_remove(&units[i]);
+				else funcs.unit_finder_insert(&units[i], new_bbs[i]);
+			}
+			now = bench_clock::now();
+			insert_time += now - start;
+			start = now;
+			for (auto& v : areas) {
+				for (unit_t* u : funcs.find_units(v)) results.push_back(u);
+			}
+			now = bench_clock::now();
+			find_time += now - start;
+			start = now;
+			for (auto& v : areas) {
+				// Searches are from the middle of the area, for units that pass
+				// some test.
+				xy pos = (v.from + v.to) / 2;
+				unit_t* nearest = funcs.find_nearest_unit(pos, v, [&](unit_t* u) {
+					++predicate_calls;
+					return u->index % 4 != 0;
+				});
+				nearest_results.push_back(nearest);
+				if (nearest) ++found;
+			}
+			nearest_time += bench_clock::now() - start;
+			found += results.size();
+			if (soa) {
+				start = bench_clock::now();
+				size_t soa_found = 0;
+				for (auto& v : areas) {
+					funcs.unit_soa_find_units(v, [&](size_t) {
+						++soa_found;
+					});
+				}
+				soa_find_time += bench_clock::now() - start;
+				if (soa_found != results.size()) error("frame %d: unit_soa_find_units found %d units, find_units %d", frame, (int)soa_found, (int)results.size());
+			}
+
+			if (reference) {
+				start = bench_clock::now();
+				for (int i = 0; i != unit_count; ++i) {
+					if (alive[i]) ref.reinsert(&units[i], bbs[i], new_bbs[i]);
+				}
+				now = bench_clock::now();
+				ref_reinsert_time += now - start;
+				start = now;
+				for (int i : churn) {
+					if (alive[i]) ref.remove(&units[i], new_bbs[i]);
+					else ref.insert(&units[i], new_bbs[i]);
+				}
+				now = bench_clock::now();
+				ref_insert_time += now - start;
+				start = now;
+				for (auto& v : areas) {
+					ref.find(v, game_st->max_unit_width, game_st->max_unit_height, units.data(), ref_results);
+				}
+				ref_find_time += bench_clock::now() - start;
+				check(frame);
+				if (results != ref_results) error("frame %d: find_units results differ", frame);
+				ref_results.clear();
+				size_t ref_predicate_calls = 0;
+				for (size_t i = 0; i != areas.size(); ++i) {
+					auto& v = areas[i];
+					unit_t* nearest = ref.find_nearest(funcs, (v.from + v.to) / 2, v, [&](unit_t* u) {
+						++ref_predicate_calls;
+						return u->index % 4 != 0;
+					});
+					if (nearest != nearest_results[i]) error("frame %d: find_nearest_unit results differ", frame);
+				}
+				if (ref_predicate_calls != predicate_calls) error("frame %d: find_nearest_unit called the predicate %d times, expected %d", frame, (int)predicate_calls, (int)ref_predicate_calls);
+				check_bot_queries(frame);
+				if (soa) {
+					a_vector<unit_t*> soa_results;
+					for (auto& v : areas) {
+						results.clear();
+						for (unit_t* u : funcs.find_units(v)) results.push_back(u);
+						soa_results.clear();
+						funcs.unit_soa_find_units(v, [&](size_t index) {
+							soa_results.push_back(&units[index]);
+						});
+						std::sort(results.begin(), results.end());
+						if (results != soa_results) error("frame %d: unit_soa_find_units results differ", frame);
+					}
+				}
+			}
+			results.clear();
+			nearest_results.clear();
+			predicate_calls = 0;
+			for (int i = 0; i != unit_count; ++i) {
+				if (alive[i]) bbs[i] = new_bbs[i];
+			}
+			for (int i : churn) {
+				alive[i] = !alive[i];
+				bbs[i] = alive[i] ? new_bbs[i] : rect{{-1, -1}, {-1, -1}};
+			}
+		}
+
+		auto per_frame = [&](bench_clock::duration d) {
+			return milliseconds(d) * 1000 / frames;
+		};
+		printf("%d units, %d frames, %d queries per frame, %d units found\n", unit_count, frames, queries, (int)found);
+		printf("us per frame     insert/remove   reinsert   find_units   find_nearest_unit\n");
+		printf("unit finder      %13.3f %10.3f %12.3f %19.3f\n", per_frame(insert_time), per_frame(reinsert_time), per_frame(find_time), per_frame(nearest_time));
+		if (soa) printf("unit_soa         %13s %10s %12.3f\n", "", "", per_frame(soa_find_time));
+		if (batch) printf("%d flushes, %.1f moves per flush\n", (int)funcs.unit_finder_flushes, funcs.unit_finder_flushes ? (double)funcs.unit_finder_flushed_moves / funcs.unit_finder_flushes : 0.0);
+		if (reference) {
+			printf("sorted vectors   %13.3f %10.3f %12.3f\n", per_frame(ref_insert_time), per_frame(ref_reinsert_time), per_frame(ref_find_time));
+			printf("entries, find_units and find_nearest_unit results identical in every frame\n");
+		}
+	} catch (const exception& e) {
+		printf("error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
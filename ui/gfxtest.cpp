@@ -45,7 +45,7 @@ void fatal_error_str(a_string str) {
 }
 
 struct saved_state {
-	state st;
+	state_snapshot snapshot;
 	action_state action_st;
 	std::array<apm_t, 12> apm;
 };
@@ -85,8 +85,9 @@ struct main_t {
 				auto i = saved_states.find(ui.st.current_frame);
 				if (i == saved_states.end()) {
 					auto v = std::make_unique<saved_state>();
-					v->st = copy_state(ui.st);
-					v->action_st = copy_state(ui.action_st, ui.st, v->st);
+					auto base = saved_states.lower_bound(ui.st.current_frame);
+					v->snapshot.take(ui.st, base != saved_states.begin() ? &std::prev(base)->second->snapshot : nullptr);
+					v->action_st = copy_state(ui.action_st, ui.st, ui.st);
 					v->apm = ui.apm;
 
 					a_map<int, std::unique_ptr<saved_state>> new_saved_states;
@@ -110,9 +111,9 @@ struct main_t {
 					auto i = saved_states.lower_bound(ui.replay_frame);
 					if (i != saved_states.begin()) --i;
 					auto& v = i->second;
-					if (ui.st.current_frame > ui.replay_frame || v->st.current_frame > ui.st.current_frame) {
-						ui.st = copy_state(v->st);
-						ui.action_st = copy_state(v->action_st, v->st, ui.st);
+					if (ui.st.current_frame > ui.replay_frame || v->snapshot.copyable.current_frame > ui.st.current_frame) {
+						v->snapshot.restore(ui.st);
+						ui.action_st = copy_state(v->action_st, ui.st, ui.st);
 						ui.apm = v->apm;
 					}
 				}
@@ -6,6 +6,10 @@
 #include "native_window_drawing.h"
 #include "native_sound.h"
 
+#ifdef OPENBW_HEADLESS
+#error "the ui can not be built with OPENBW_HEADLESS"
+#endif
+
 namespace bwgame {
 
 struct vr4_entry {